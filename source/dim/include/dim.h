@@ -149,6 +149,7 @@ _DIM_PROTO( short _swaps,   (short s) );
 #define MAX_REGISTRATION_UNIT 100
 #define CONN_BLOCK		32
 #define MAX_CONNS		32
+#define MAX_IO_THREADS	1
 #define ID_BLOCK		64
 #define TCP_RCV_BUF_SIZE	4096
 #define TCP_SND_BUF_SIZE	4096
@@ -161,6 +162,7 @@ _DIM_PROTO( short _swaps,   (short s) );
 #define MAX_REGISTRATION_UNIT 100
 #define CONN_BLOCK		256
 #define MAX_CONNS		1024
+#define MAX_IO_THREADS	32
 #define ID_BLOCK		512
 #define TCP_RCV_BUF_SIZE	/*16384*//*32768*/65536
 #define TCP_SND_BUF_SIZE	/*16384*//*32768*/65536
@@ -372,9 +374,12 @@ typedef struct timer_entry{
 	struct timer_entry *prev;
 	struct timer_entry *next_done;
 	int time;
-	int time_left;
+	int expires;		/* Tick at which the entry is due */
 	void (*user_routine)();
 	dim_long tag;
+	int queue_id;
+	struct timer_entry *tag_next;	/* dtq_start_timer() entries by tag */
+	struct timer_entry *tag_prev;
 } TIMR_ENT;
 
 typedef struct {
@@ -386,14 +391,26 @@ typedef struct {
 	char *curr_buffer;
 	int curr_size;
 	int full_size;
+	int read_head;		/* Unprocessed data in buffer, see ast_read_h() */
+	int read_tail;
 	int protocol;
 	CONN_STATE state;
 	int writing;
 	int saw_init;
+	void *write_queue;	/* Data queued by dna_write() */
+	void *write_last;
+	void *write_spare;	/* Write buffer kept for the connection */
+	int write_pending;	/* do_dna_write() to be called */
+	int write_event;	/* ... when the socket is writable */
 } DNA_CONNECTION;
 
 extern DllExp DIM_NOSHARE DNA_CONNECTION *Dna_conns;
 
+typedef struct {
+	char *base;
+	int size;
+} TCPIP_IOVEC;
+
 typedef struct {
 	int channel;
 	int mbx_channel;
@@ -408,10 +425,15 @@ typedef struct {
 	char task[MAX_TASK_NAME];
 	int port;
 	int reading;
+	int read_some;		/* Deliver partial reads, see tcpip_start_read_some() */
 	int timeout;
 	int write_timedout;
 	TIMR_ENT *timr_ent;
 	time_t last_used;
+	int io_thread;		/* IO thread serving the channel + 1, 0 if none */
+	void (*write_rout)();	/* Called when the channel can be written to */
+	void *writer;		/* Write lock and state, see tcpip_get_writer() */
+	void *reader;		/* Read lock and state, see reader_get() */
 } NET_CONNECTION;
  
 extern DllExp DIM_NOSHARE NET_CONNECTION *Net_conns;
@@ -510,14 +532,28 @@ _DIM_PROTOE( int tcpip_open_server,     (int conn_id, char *task, int *port) );
 _DIM_PROTOE( int tcpip_open_connection, (int conn_id, int channel) );
 _DIM_PROTOE( int tcpip_start_read,      (int conn_id, char *buffer, int size,
                                     void (*ast_routine)()) );
+_DIM_PROTOE( int tcpip_start_read_some, (int conn_id, char *buffer, int size,
+                                    void (*ast_routine)()) );
 _DIM_PROTOE( int tcpip_start_listen,    (int conn_id, void (*ast_routine)()) );
 _DIM_PROTOE( int tcpip_write,           (int conn_id, char *buffer, int size) );
 _DIM_PROTOE( void tcpip_get_node_task,  (int conn_id, char *node, char *task) );
 _DIM_PROTOE( int tcpip_close,           (int conn_id) );
 _DIM_PROTOE( int tcpip_failure,         (int code) );
+_DIM_PROTOE( void *tcpip_get_writer,    (int conn_id, int *gen) );
+_DIM_PROTOE( int tcpip_is_writer,       (int conn_id, void *writer, int gen) );
+_DIM_PROTOE( int tcpip_writer_sendv,    (void *writer, int gen, TCPIP_IOVEC *iov, int n_iov,
+										 int nowait) );
+_DIM_PROTOE( int tcpip_writer_sendv_some, (void *writer, int gen, TCPIP_IOVEC *iov,
+										 int n_iov, int *written) );
+_DIM_PROTOE( int tcpip_start_write,     (int conn_id, void (*write_rout)()) );
 _DIM_PROTOE( void tcpip_report_error,   (int code) );
 
 
+/* Object locks */
+_DIM_PROTOE( void *dim_mutex_create,  () );
+_DIM_PROTOE( void dim_mutex_lock,     (void *mutex) );
+_DIM_PROTOE( void dim_mutex_unlock,   (void *mutex) );
+
 /* DTQ */
 _DIM_PROTOE( int dtq_create,          (void) );
 _DIM_PROTOE( int dtq_delete,          (int queue_id) );
@@ -566,6 +602,35 @@ _DIM_PROTOE( SLL *sll_search_next_remove, ( SLL *item, int offset, char *data, i
 _DIM_PROTOE( SLL *sll_get_head, 		  ( SLL *head ) );
 
 _DIM_PROTOE( int HashFunction,         ( char *name, int max ) );
+_DIM_PROTOE( unsigned int HashName,    ( char *name ) );
+
+typedef struct {
+	unsigned int hash;
+	int marked;
+	void *item;
+} HASH_SLOT;
+
+typedef struct {
+	HASH_SLOT *slots;
+	int *marks;			/* Marked items per block of slots */
+	int size;
+	int n_items;
+	int n_deleted;
+	int walking;		/* Walks in progress, see hash_table_get_next() */
+	HASH_SLOT *pending;	/* Items inserted while walking a full table */
+	int n_pending;
+	int pending_size;
+	int name_offset;	/* Offset of the (null terminated) name in the items */
+} HASH_TABLE;
+
+_DIM_PROTOE( void hash_table_init,     ( HASH_TABLE *table, int name_offset ) );
+_DIM_PROTOE( int hash_table_insert,    ( HASH_TABLE *table, void *item ) );
+_DIM_PROTOE( int hash_table_remove,    ( HASH_TABLE *table, void *item ) );
+_DIM_PROTOE( void *hash_table_find,    ( HASH_TABLE *table, char *name ) );
+_DIM_PROTOE( void hash_table_unmark,   ( HASH_TABLE *table, int index ) );
+_DIM_PROTOE( void *hash_table_get_next, ( HASH_TABLE *table, int *curr_index,
+									void *prevp, int marked ) );
+_DIM_PROTOE( void hash_table_walk_end, ( HASH_TABLE *table, int *curr_index ) );
 
 _DIM_PROTOE( int copy_swap_buffer_out, (int format, FORMAT_STR *format_data, 
 					void *buff_out, void *buff_in, int size) );
@@ -239,6 +239,8 @@ _DIM_PROTOE( void dim_set_keepalive_timeout,		(int secs) );
 _DIM_PROTOE( int dim_get_keepalive_timeout,		() );
 _DIM_PROTOE( void dim_set_listen_backlog,		(int size) );
 _DIM_PROTOE( int dim_get_listen_backlog,		() );
+_DIM_PROTOE( int dim_set_io_threads,		(int n) );
+_DIM_PROTOE( int dim_get_io_threads,		() );
 
 #ifdef WIN32
 #define getpid _getpid
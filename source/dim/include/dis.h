@@ -24,6 +24,13 @@
 #define dis_selective_update_service dis_selective_update_service_
 #define dis_get_timestamp dis_get_timestamp_
 
+/* One contiguous part of the contents of a service update,
+   see dis_update_service_segments() */
+typedef struct {
+	void *address;
+	int size;
+} DIS_SEGMENT;
+
 #ifdef __cplusplus
 extern "C" {
 #define __CXX_CONST const
@@ -56,6 +63,10 @@ _DIM_PROTOE( int dis_set_timestamp,     (unsigned service_id,
 					int secs, int millisecs) );
 _DIM_PROTOE( int dis_selective_update_service,   (unsigned service_id, 
 					int *client_id_list) );
+_DIM_PROTOE( int dis_update_service_segments,   (unsigned service_id, 
+					DIS_SEGMENT *segments, int n_segments) );
+_DIM_PROTOE( int dis_selective_update_service_segments,   (unsigned service_id, 
+					DIS_SEGMENT *segments, int n_segments, int *client_id_list) );
 _DIM_PROTOE( void dis_disable_padding,      		() );
 _DIM_PROTOE( int dis_get_timeout,      		(unsigned service_id, int client_id) );
 _DIM_PROTOE( char *dis_get_error_services,	() );
@@ -189,6 +189,8 @@ public :
 	int updateService( char *string );
 	
 	int updateService( void *structure, int size );
+	// Gather the contents from segments (formats without swapping only)
+	int updateService( DIS_SEGMENT *segments, int nSegments );
 	
 	// Selective Update methods
 	int selectiveUpdateService(int *cids);
@@ -201,6 +203,7 @@ public :
 	int selectiveUpdateService( char *string, int *cids );
 	
 	int selectiveUpdateService( void *structure, int size, int *cids );
+	int selectiveUpdateService( DIS_SEGMENT *segments, int nSegments, int *cids );
 	
 	void setQuality(int quality);
 	void setTimestamp(int secs, int millisecs);
@@ -328,6 +331,7 @@ public :
 	int itsSizeOut;
 
 	void setData(void *data, int size);
+	void setData(DIS_SEGMENT *segments, int nSegments);
 	void setData(int &data);
 	void setData(float &data);
 	void setData(double &data);
@@ -0,0 +1,100 @@
+#include <iostream>
+using namespace std;
+#include <dic.hxx>
+#include <stdio.h>
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
+/* Subscribes to the services of contentionServer, slowly if asked to (to
+   make the server block writing to it), or measures the round trip time of
+   its RPC while receiving the services */
+
+#define TEST_TIME 10
+
+int SlowUs = 0;
+int NReceived;
+
+class Service : public DimInfo
+{
+	void infoHandler()
+	{
+	  NReceived++;
+	  if(SlowUs)
+		usleep(SlowUs);
+	}
+public :
+	Service(char *name) : DimInfo(name,(char *)"--") {}
+};
+
+static double now_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, nServices = 0, nRpcs = 0;
+	Service **services;
+	DimBrowser br;
+	char *name, *format, rpcName[128];
+	double start, t, sum = 0, max = 0;
+
+	if(argc < 2)
+	{
+		printf("Usage: contentionClient rpc | slow <usecs per message>\n");
+		return 0;
+	}
+	if(!strcmp(argv[1], "slow"))
+		sscanf(argv[2],"%d",&SlowUs);
+	br.getServices("CONTENTION_SERVICE_*");
+	while(br.getNextService(name, format)!= 0)
+	{
+		nServices++;
+	}
+	services = new Service*[nServices];
+	i = 0;
+	while(br.getNextService(name, format)!= 0)
+	{
+	  services[i++] = new Service(name);
+	}
+	rpcName[0] = '\0';
+	br.getServices("CONTENTION_RPC_*");
+	while(br.getNextService(name, format)!= 0)
+	{
+		strcpy(rpcName, name);
+		if((name = strstr(rpcName, "/RpcIn")))
+			*name = '\0';
+	}
+	sleep(2);
+	NReceived = 0;
+	if(SlowUs || !rpcName[0])
+	{
+		sleep(TEST_TIME);
+		cout << "Received " << NReceived/TEST_TIME << " messages/s from " << nServices << " services" << endl;
+		return 1;
+	}
+	DimRpcInfo rpc(rpcName, -1);
+	start = now_us();
+	while(now_us() - start < TEST_TIME * 1000000.0)
+	{
+		t = now_us();
+		rpc.setData(nRpcs);
+		if(rpc.getInt() != nRpcs)
+		{
+			cout << "Bad RPC answer" << endl;
+			return 0;
+		}
+		t = now_us() - t;
+		sum += t;
+		if(t > max)
+			max = t;
+		nRpcs++;
+	}
+	cout << "Received " << NReceived/TEST_TIME << " messages/s from " << nServices << " services" << endl;
+	cout << "RPC round trip (us) : avg = " << sum/nRpcs << " max = " << max << " (" << nRpcs << " calls)" << endl;
+	return 1;
+}
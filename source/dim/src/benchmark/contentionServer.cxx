@@ -0,0 +1,83 @@
+#include <iostream>
+#include <dis.hxx>
+#ifdef WIN32
+#include <process.h>
+#endif
+#include <stdio.h>
+
+/* Several threads update services while clients are served RPCs,
+   to be used with contentionClient */
+
+int MsgSize, NServices, NPublishers;
+char *Msg;
+DimService **Services;
+
+class Publisher : public DimThread
+{
+	int itsIndex;
+public :
+	Publisher(int index) : itsIndex(index) {}
+	void threadHandler()
+	{
+		int i;
+
+		while(1)
+		{
+			for(i = itsIndex; i < NServices; i += NPublishers)
+			{
+				Services[i]->updateService();
+			}
+		}
+	}
+};
+
+class Echo : public DimRpc
+{
+	void rpcHandler()
+	{
+		int value = getInt();
+		setData(value);
+	}
+public :
+	Echo(char *name) : DimRpc(name, "I:1", "I:1") {}
+};
+
+int main(int argc, char *argv[])
+{
+	int i, pid;
+	char servName[64];
+	Publisher **publishers;
+
+	if(argc < 4)
+	{
+		printf("Usage: contentionServer <msg_size> <n_services> <n_publisher_threads>\n");
+		return 0;
+	}
+	sscanf(argv[1],"%d",&MsgSize);
+	sscanf(argv[2],"%d",&NServices);
+	sscanf(argv[3],"%d",&NPublishers);
+	Msg = new char[MsgSize];
+	Services = new DimService*[NServices];
+	
+	pid = getpid();
+	for(i = 0; i < NServices; i++)
+	{
+	  sprintf(servName,"CONTENTION_SERVICE_%d_%03d",pid, i);
+	  Services[i] = new DimService(servName, "C", Msg, MsgSize);
+	}
+	sprintf(servName,"CONTENTION_RPC_%d",pid);
+	new Echo(servName);
+	sprintf(servName,"CONTENTION_%d",pid);
+	DimServer::start(servName);
+	publishers = new Publisher*[NPublishers];
+	for(i = 0; i < NPublishers; i++)
+	{
+	  publishers[i] = new Publisher(i);
+	  publishers[i]->start();
+	}
+	while(1)
+	{
+	  sleep(10);
+	}
+	return 0;
+}
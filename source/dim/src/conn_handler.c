@@ -33,10 +33,21 @@ DllExp DIM_NOSHARE NET_CONNECTION *Net_conns = 0;
 DllExp DIM_NOSHARE int Curr_N_Conns = 0;
 #endif
 
+/* Ids are the index in Id_arr plus the generation of the entry, which
+ * is incremented when the id is freed, so that a stale id is not taken
+ * for the one now using the same entry. Ids have to stay below 0x08000000,
+ * the upper bits are used as flags in the DIM protocol.
+ */
+#define ID_INDEX_BITS	22
+#define ID_INDEX_MASK	((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK		0x1F
+
 typedef struct id_item
 {
 	void *ptr;
 	SRC_TYPES type;
+	int gen;
+	int next_free;
 }ID_ITEM;
 
 static ID_ITEM *Id_arr;
@@ -44,7 +55,12 @@ static ID_ITEM *Id_arr;
 static void **Id_arr;
 */
 static int Curr_N_Ids = 0;
-static int Curr_id = 1;
+static int Free_id_head = 0;	/* Free entries, oldest first */
+static int Free_id_tail = 0;
+
+static int *Free_conns = 0;		/* Free connections, a stack: the last freed
+							 * is reused first, new ones lowest id first */
+static int N_free_conns = 0;
 
 void conn_arr_create(SRC_TYPES type)
 {
@@ -75,21 +91,33 @@ void conn_arr_create(SRC_TYPES type)
 	}
 }
 
+static void free_conns_add(int first, int last)
+{
+	/* Push the connections from last down to first, so that the lowest
+	 * one is used first */
+	int i;
+
+	Free_conns = realloc( Free_conns, (size_t)Curr_N_Conns * sizeof(int) );
+	for( i = last; i >= first; i-- )
+	{
+		if( !Dna_conns[i].busy )
+			Free_conns[N_free_conns++] = i;
+	}
+}
 
 int conn_get()
 {
-	register DNA_CONNECTION *dna_connp;
-	int i, n_conns, conn_id;
+	int n_conns, conn_id, old_n_conns;
 
 	DISABLE_AST
-	for( i = 1, dna_connp = &Dna_conns[1]; i < Curr_N_Conns; i++, dna_connp++ )
+	if( !Free_conns )
+		free_conns_add(1, Curr_N_Conns - 1);
+	if( N_free_conns )
 	{
-		if( !dna_connp->busy )
-		{
-			dna_connp->busy = TRUE;
-			ENABLE_AST
-			return(i);
-		}
+		conn_id = Free_conns[--N_free_conns];
+		Dna_conns[conn_id].busy = TRUE;
+		ENABLE_AST
+		return(conn_id);
 	}
 	n_conns = Curr_N_Conns + CONN_BLOCK;
 	Dna_conns = arr_increase( Dna_conns, sizeof(DNA_CONNECTION), n_conns );
@@ -107,8 +135,10 @@ int conn_get()
 	default:
 		break;
 	}
-	conn_id = Curr_N_Conns;
+	old_n_conns = Curr_N_Conns;
 	Curr_N_Conns = n_conns;
+	conn_id = old_n_conns;
+	free_conns_add(conn_id + 1, n_conns - 1);
 	Dna_conns[conn_id].busy = TRUE;
 	ENABLE_AST
 	return(conn_id);
@@ -118,7 +148,12 @@ int conn_get()
 void conn_free(int conn_id)
 {
 	DISABLE_AST
-	Dna_conns[conn_id].busy = FALSE;
+	if( Dna_conns[conn_id].busy )
+	{
+		Dna_conns[conn_id].busy = FALSE;
+		if( Free_conns )
+			Free_conns[N_free_conns++] = conn_id;
+	}
 	ENABLE_AST
 }
 
@@ -132,11 +167,27 @@ void *arr_increase(void *conn_ptr, int conn_size, int n_conns)
 	return(new_ptr);
 }
 
+static void free_ids_add(int first, int last)
+{
+	int i;
+
+	for( i = first; i <= last; i++ )
+	{
+		Id_arr[i].next_free = 0;
+		if( Free_id_tail )
+			Id_arr[Free_id_tail].next_free = i;
+		else
+			Free_id_head = i;
+		Free_id_tail = i;
+	}
+}
+
 void id_arr_create()
 {
 
 	Curr_N_Ids = ID_BLOCK;
 	Id_arr = (void *) calloc( (size_t)Curr_N_Ids, sizeof(ID_ITEM));
+	free_ids_add(1, Curr_N_Ids - 1);
 }
 
 
@@ -145,13 +196,13 @@ void *id_arr_increase(void *id_ptr, int id_size, int n_ids)
 	register char *new_ptr;
 
 	new_ptr = realloc( id_ptr, (size_t)(id_size * n_ids) );
-	memset( new_ptr + id_size * Curr_N_Ids, 0, (size_t)(id_size * ID_BLOCK) );
+	memset( new_ptr + id_size * Curr_N_Ids, 0, (size_t)(id_size * (n_ids - Curr_N_Ids)) );
 	return(new_ptr);
 }
 
 int id_get(void *ptr, SRC_TYPES type)
 {
-	register int i, id;
+	register int id, n_ids;
 	register ID_ITEM *idp;
 
 	DISABLE_AST
@@ -159,48 +210,56 @@ int id_get(void *ptr, SRC_TYPES type)
 	{
 		id_arr_create();
 	}
-	for( i = Curr_id, idp = &Id_arr[Curr_id]; i < Curr_N_Ids; i++, idp++ )
+	if(!Free_id_head)
 	{
-		if( !idp->type )
+		n_ids = Curr_N_Ids * 2;
+		if(n_ids > ID_INDEX_MASK + 1)
+			n_ids = ID_INDEX_MASK + 1;
+		if(n_ids == Curr_N_Ids)
 		{
-			idp->ptr = ptr;
-			idp->type = type;
-			Curr_id = i;
 			ENABLE_AST
-			return(i);
+			return(0);
 		}
+		Id_arr = id_arr_increase( Id_arr, sizeof(ID_ITEM), n_ids );
+		free_ids_add(Curr_N_Ids, n_ids - 1);
+		Curr_N_Ids = n_ids;
 	}
-	Id_arr = id_arr_increase( Id_arr, sizeof(ID_ITEM), Curr_N_Ids + ID_BLOCK );
-	id = Curr_N_Ids;
+	id = Free_id_head;
 	idp = &Id_arr[id];
+	Free_id_head = idp->next_free;
+	if(!Free_id_head)
+		Free_id_tail = 0;
 	idp->ptr = ptr;
 	idp->type = type;
-	Curr_N_Ids += ID_BLOCK;
-	Curr_id = id;
+	id |= idp->gen << ID_INDEX_BITS;
 	ENABLE_AST
 	return(id);
 }
 
+static ID_ITEM *id_get_item(int id, SRC_TYPES type)
+{
+	ID_ITEM *idp;
+	int index;
+
+	index = id & ID_INDEX_MASK;
+	if((id <= 0) || (index >= Curr_N_Ids))
+		return(0);
+	idp = &Id_arr[index];
+	if((idp->type != type) || (idp->gen != (id >> ID_INDEX_BITS)))
+		return(0);
+	return(idp);
+}
+
 void *id_get_ptr(int id, SRC_TYPES type)
 {
 	ID_ITEM *idp;
-	void *ptr;
+	void *ptr = 0;
 	DISABLE_AST
 
-	if((id >= Curr_N_Ids) || (id <= 0))
-	{
-		ENABLE_AST
-		return(0);
-	}
-	idp = &Id_arr[id];
-	if(idp->type == type)
-	{
+	if( (idp = id_get_item(id, type)) )
 		ptr = idp->ptr;
-		ENABLE_AST
-		return(ptr);
-	}
 	ENABLE_AST
-	return(0);
+	return(ptr);
 }
 
 void id_free(int id, SRC_TYPES type)
@@ -208,12 +267,12 @@ void id_free(int id, SRC_TYPES type)
 	ID_ITEM *idp;
 	DISABLE_AST
 
-	idp = &Id_arr[id];
-	if(idp->type == type)
+	if( (idp = id_get_item(id, type)) )
 	{
 		idp->type = 0;
 		idp->ptr = 0;
+		idp->gen = (idp->gen + 1) & ID_GEN_MASK;
+		free_ids_add(id & ID_INDEX_MASK, id & ID_INDEX_MASK);
 	}
-	Curr_id = 1;
 	ENABLE_AST
 }
@@ -16,6 +16,8 @@
 #endif
 
 pthread_t IO_thread = 0;
+pthread_t IO_threads[MAX_IO_THREADS];
+int N_IO_threads = 0;
 pthread_t ALRM_thread = 0;
 pthread_t INIT_thread = 0;
 pthread_t MAIN_thread = 0;
@@ -35,6 +37,12 @@ int INIT_count = 0;
 int WAIT_count = 0;
 */
 int DIM_THR_init_done = 0;
+extern pthread_t Dim_thr_locker;
+extern int Dim_thr_counter;
+extern pthread_mutex_t Global_DIM_mutex;
+static int Dim_thr_cancel_state;
+
+/* IO thread number tag (0 is the main one, which initializes tcpip) */
 
 void *dim_tcpip_thread(void *tag)
 {
@@ -46,10 +54,11 @@ void *dim_tcpip_thread(void *tag)
 	thr_getprio(thr_self(),&prio);
 	thr_setprio(thr_self(),prio+10);
 	*/
-	if(tag){}
-	IO_thread = pthread_self();
-
-	dim_tcpip_init(1);
+	if(!tag)
+	{
+		IO_thread = pthread_self();
+		dim_tcpip_init(1);
+	}
 	if(INIT_thread)
 	{
 #ifndef darwin
@@ -60,7 +69,7 @@ void *dim_tcpip_thread(void *tag)
 	}
 	while(1)
     {
-		tcpip_task();
+		tcpip_task(tag);
 		/*
 #ifndef darwin
 		sem_post(&DIM_WAIT_Sema);
@@ -111,6 +120,7 @@ void *dim_dtq_thread(void *tag)
 void dim_init()
 {
 	pthread_t t_id;
+	dim_long i;
 	void ignore_sigpipe();
 	extern int dna_init();
 /*
@@ -169,22 +179,28 @@ void dim_init()
 #else
 		sem_wait(DIM_INIT_Semap);
 #endif
+		N_IO_threads = dim_get_io_threads();
+		for(i = 0; i < N_IO_threads; i++)
+		{
 #if defined (LYNXOS) && !defined (__Lynx__)
-		pthread_create(&t_id, attr, dim_tcpip_thread, 0);
+			pthread_create(&t_id, attr, dim_tcpip_thread, (void *)i);
 #else
-		pthread_create(&t_id, &attr, dim_tcpip_thread, 0);
+			pthread_create(&t_id, &attr, dim_tcpip_thread, (void *)i);
 #endif
+			IO_threads[i] = t_id;
 #ifndef darwin
-		sem_wait(&DIM_INIT_Sema);
+			sem_wait(&DIM_INIT_Sema);
 #else
-		sem_wait(DIM_INIT_Semap);
+			sem_wait(DIM_INIT_Semap);
 #endif
+		}
 		INIT_thread = 0;
 	}
 }
 
 void dim_stop()
 {
+	int i, n_locks = 0, cancel_state = 0;
 	void dim_tcpip_stop(), dim_dtq_stop();
 /*
 	int i;
@@ -198,14 +214,31 @@ void dim_stop()
 	if(n)
 		return;
 */
-	if(IO_thread)
-		pthread_cancel(IO_thread);
+	/* The threads may be waiting for the DIM lock, held by the caller, they
+	   can only be cancelled once they had it */
+	if(Dim_thr_locker == pthread_self())
+	{
+		n_locks = Dim_thr_counter;
+		cancel_state = Dim_thr_cancel_state;
+		Dim_thr_counter = 0;
+		Dim_thr_locker = 0;
+		pthread_mutex_unlock(&Global_DIM_mutex);
+	}
+	for(i = 0; i < N_IO_threads; i++)
+		pthread_cancel(IO_threads[i]);
 	if(ALRM_thread)
 		pthread_cancel(ALRM_thread);
-	if(IO_thread) 
-		pthread_join(IO_thread,0);
+	for(i = 0; i < N_IO_threads; i++)
+		pthread_join(IO_threads[i],0);
 	if(ALRM_thread) 
 		pthread_join(ALRM_thread,0);
+	if(n_locks)
+	{
+		pthread_mutex_lock(&Global_DIM_mutex);
+		Dim_thr_locker = pthread_self();
+		Dim_thr_counter = n_locks;
+		Dim_thr_cancel_state = cancel_state;
+	}
 #ifndef darwin 		
 	sem_destroy(&DIM_INIT_Sema);
 	/*
@@ -224,6 +257,7 @@ void dim_stop()
 	dim_tcpip_stop();
 	dim_dtq_stop();	
 	IO_thread = 0;
+	N_IO_threads = 0;
 	ALRM_thread = 0;
 	DIM_THR_init_done = 0;
 }
@@ -255,7 +289,7 @@ int dim_stop_thread(dim_long t_id)
 int dim_set_scheduler_class(int pclass)
 {
 #ifdef __linux__
-	int ret, prio, p;
+	int ret, prio, p, i;
 	struct sched_param param;
 
 	if(pclass == 0)
@@ -277,12 +311,15 @@ int dim_set_scheduler_class(int pclass)
 	ret = pthread_setschedparam(MAIN_thread, pclass, &param);   
 	if(ret)
 	  return 0;
-	ret = pthread_getschedparam(IO_thread, &p, &param);   
-	if( (p == SCHED_OTHER) || (pclass == SCHED_OTHER) )
-		param.sched_priority = prio;
-	ret = pthread_setschedparam(IO_thread, pclass, &param);   
-	if(ret)
-	  return 0;
+	for(i = 0; i < N_IO_threads; i++)
+	{
+		ret = pthread_getschedparam(IO_threads[i], &p, &param);   
+		if( (p == SCHED_OTHER) || (pclass == SCHED_OTHER) )
+			param.sched_priority = prio;
+		ret = pthread_setschedparam(IO_threads[i], pclass, &param);   
+		if(ret)
+		  return 0;
+	}
 	ret = pthread_getschedparam(ALRM_thread, &p, &param);   
 	if( (p == SCHED_OTHER) || (pclass == SCHED_OTHER) )
 		param.sched_priority = prio;
@@ -310,14 +347,22 @@ int dim_set_priority(int threadId, int prio)
 {
 #ifdef __linux__
 	pthread_t id = MAIN_thread;
-	int ret;
+	int ret, i;
 	int pclass;
 	struct sched_param param;
 
 	if(threadId == 1)
 		id = MAIN_thread;
 	else if(threadId == 2)
+	{
+		for(i = 1; i < N_IO_threads; i++)
+		{
+			ret = pthread_getschedparam(IO_threads[i], &pclass, &param);   
+			param.sched_priority = prio;
+			ret = pthread_setschedparam(IO_threads[i], pclass, &param);
+		}
 		id = IO_thread;
+	}
 	else if(threadId == 3)
 		id = ALRM_thread;
 
@@ -409,6 +454,7 @@ void dim_stop_threads()
 int dim_wait(void)
 {
 	pthread_t id;
+	int i;
 	
 	id = pthread_self();
 
@@ -416,6 +462,11 @@ int dim_wait(void)
 	  {
 		return(-1);
 	  }
+	for(i = 1; i < N_IO_threads; i++)
+	{
+		if(id == IO_threads[i])
+			return(-1);
+	}
 	/*
 #ifndef darwin
 	sem_wait(&DIM_WAIT_Sema);
@@ -452,8 +503,12 @@ pthread_cond_t Global_cond = PTHREAD_COND_INITIALIZER;
 int Global_cond_counter = 0;
 int Global_cond_waiters = 0;
 
+/* DIM threads are not cancelled (by dim_stop()) while holding a DIM lock */
+
 void dim_lock()
 {
+	int old_state;
+
 	/*printf("Locking %d ", pthread_self());*/
     if(Dim_thr_locker != pthread_self())
     {
@@ -462,8 +517,10 @@ void dim_lock()
 		pthread_testcancel();
 #endif
 */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
 		pthread_mutex_lock(&Global_DIM_mutex);
 		Dim_thr_locker=pthread_self();
+		Dim_thr_cancel_state = old_state;
 		/*printf(": Locked ");*/
 	}
     /*printf("Counter = %d\n",Dim_thr_counter);*/
@@ -471,13 +528,17 @@ void dim_lock()
 }
 void dim_unlock()	
 {
+	int old_state;
+
 	/*printf("Un-Locking %d ", pthread_self());*/
     Dim_thr_counter--;
     /*printf("Counter = %d ",Dim_thr_counter);*/
     if(!Dim_thr_counter)
     {
 		Dim_thr_locker=0;
+		old_state = Dim_thr_cancel_state;
 		pthread_mutex_unlock(&Global_DIM_mutex);
+		pthread_setcancelstate(old_state, &old_state);
 		/*printf(": Un-Locked ");*/
 	}
 	/*     printf("\n");*/
@@ -512,6 +573,58 @@ void dim_signal_cond()
   pthread_mutex_unlock(&Global_cond_mutex);
 }
 
+/* Locks protecting a single object (a connection, a service...), to be
+   taken after the DIM lock when both are needed, never before it */
+
+typedef struct {
+	pthread_mutex_t mutex;
+	int counter;
+	int cancel_state;
+} DIM_MUTEX;
+
+void *dim_mutex_create()
+{
+	DIM_MUTEX *mutex;
+	pthread_mutexattr_t attr;
+
+	mutex = (DIM_MUTEX *)malloc(sizeof(DIM_MUTEX));
+	if(!mutex)
+		return(0);
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	mutex->counter = 0;
+	mutex->cancel_state = 0;
+	return((void *)mutex);
+}
+
+void dim_mutex_lock(void *mutexp)
+{
+	DIM_MUTEX *mutex = (DIM_MUTEX *)mutexp;
+	int old_state;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+	pthread_mutex_lock(&mutex->mutex);
+	if(!mutex->counter++)
+		mutex->cancel_state = old_state;
+}
+
+void dim_mutex_unlock(void *mutexp)
+{
+	DIM_MUTEX *mutex = (DIM_MUTEX *)mutexp;
+	int old_state;
+
+	if(--mutex->counter)
+	{
+		pthread_mutex_unlock(&mutex->mutex);
+		return;
+	}
+	old_state = mutex->cancel_state;
+	pthread_mutex_unlock(&mutex->mutex);
+	pthread_setcancelstate(old_state, &old_state);
+}
+
 #else
 
 void dim_init()
@@ -551,6 +664,23 @@ int dim_stop_thread(dim_long t_id)
 	printf("dim_stop_thread: not available\n");
 	return 0;
 }
+
+void *dim_mutex_create()
+{
+	static int dummy;
+
+	return((void *)&dummy);
+}
+
+void dim_mutex_lock(void *mutex)
+{
+	if(mutex){}
+}
+
+void dim_mutex_unlock(void *mutex)
+{
+	if(mutex){}
+}
 #endif
 
 #else
@@ -883,6 +1013,21 @@ void dim_unlock()
 	ReleaseMutex(Global_DIM_mutex);
 }
 
+void *dim_mutex_create()
+{
+	return((void *)CreateMutex(NULL,FALSE,NULL));
+}
+
+void dim_mutex_lock(void *mutex)
+{
+	WaitForSingleObject((HANDLE)mutex, INFINITE);
+}
+
+void dim_mutex_unlock(void *mutex)
+{
+	ReleaseMutex((HANDLE)mutex);
+}
+
 void dim_pause()
 {
 HANDLE handles[2];
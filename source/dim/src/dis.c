@@ -19,6 +19,7 @@
 #define DEBUG
 */
 #include <time.h>
+#include <stddef.h>
 #ifdef VAX
 #include <timeb.h>
 #else
@@ -87,6 +88,8 @@ typedef struct serv {
 	DIS_DNS_CONN *dnsp;
 	int delay_delete;
 	int to_delete;
+	DIS_SEGMENT *segments;
+	int n_segments;
 } SERVICE;
 
 typedef struct reqp_ent {
@@ -305,6 +308,8 @@ static unsigned do_dis_add_service_dns( char *name, char *type, void *address, i
 	new_serv->tid = 0;
 	new_serv->delay_delete = 0;
 	new_serv->to_delete = 0;
+	new_serv->segments = 0;
+	new_serv->n_segments = 0;
 	dnsp = dis_find_dns(dnsid);
 	if(!dnsp)
 		dnsp = create_dns(dnsid);
@@ -470,6 +475,8 @@ static unsigned do_dis_add_cmnd_dns( char *name, char *type, void (*user_routine
 	new_serv->user_secs = 0;
 	new_serv->delay_delete = 0;
 	new_serv->to_delete = 0;
+	new_serv->segments = 0;
+	new_serv->n_segments = 0;
 	service_id = id_get((void *)new_serv, SRC_DIS);
 	new_serv->id = service_id;
 	dnsp = dis_find_dns(dnsid);
@@ -1392,50 +1399,30 @@ printf("Received Request for %s, from %d  %s@%s\n",
 	}
 }
 
-/* A timeout for a timed or monitored service occured, serve it. */
+/* Get the current contents of a service on behalf of a given request */
 
-int execute_service( int req_id )
+static void get_service_data( REQUEST *reqp, int **buffp, int *size )
 {
-	int *buffp, size;
-	register REQUEST *reqp;
 	register SERVICE *servp;
-	char str[80], def[MAX_NAME];
-	int conn_id, last_conn_id;
-	int *pkt_buffer, header_size, aux;
-#ifdef WIN32
-	struct timeb timebuf;
-#else
-	struct timeval tv;
-	struct timezone *tz;
-#endif
-	FORMAT_STR format_data_cp[MAX_NAME/4];
+	static char str[80];
+	int last_conn_id, i;
 
-	reqp = (REQUEST *)id_get_ptr(req_id, SRC_DIS);
-	if(!reqp)
-		return(0);
-	if(reqp->to_delete)
-		return(0);
-	reqp->delay_delete++;
 	servp = reqp->service_ptr;
-	conn_id = reqp->conn_id;
-
-if(Debug_on)
-{
-dim_print_date_time();
-printf("Updating %s for %s@%s (req_id = %d)\n",
-	   servp->name, 
-	   Net_conns[conn_id].task, Net_conns[conn_id].node, 
-	   reqp->req_id);
-}
-
 	last_conn_id = Curr_conn_id;
-	Curr_conn_id = conn_id;
+	Curr_conn_id = reqp->conn_id;
 	if(servp->type == COMMAND)
 	{
 		sprintf(str,"This is a COMMAND Service");
-		buffp = (int *)str;
-		size = 26;
-		sprintf(def,"c:26");
+		*buffp = (int *)str;
+		*size = 26;
+	}
+	else if( servp->n_segments )
+	{
+		/* gathered by fill_service_packet() */
+		*buffp = 0;
+		*size = 0;
+		for(i = 0; i < servp->n_segments; i++)
+			*size += servp->segments[i].size;
 	}
 	else if( servp->user_routine != 0 ) 
 	{
@@ -1443,103 +1430,163 @@ printf("Updating %s for %s@%s (req_id = %d)\n",
 		{
 			Last_n_clients = dis_get_n_clients(servp->id);
 		}
-		(servp->user_routine)( &servp->tag, &buffp, &size,
+		(servp->user_routine)( &servp->tag, buffp, size,
 					&reqp->first_time );
 		reqp->first_time = 0;
 		
 	} 
 	else 
 	{
-		buffp = servp->address;
-		size = servp->size;
+		*buffp = servp->address;
+		*size = servp->size;
 	}
 	Curr_conn_id = last_conn_id;
-/* send even if no data but not if negative */
-	if( size  < 0)
-	{
-		reqp->delay_delete--;
-		return(0);
-	}
-	if( DIS_STAMPED_HEADER + size > Dis_packet_size ) 
-	{
-		if( Dis_packet_size )
-			free( Dis_packet );
-		Dis_packet = (DIS_STAMPED_PACKET *)malloc((size_t)(DIS_STAMPED_HEADER + size));
-		if(!Dis_packet)
-		{
-			reqp->delay_delete--;
-			return(0);
-		}
-		Dis_packet_size = DIS_STAMPED_HEADER + size;
-	}
-	Dis_packet->service_id = htovl(reqp->service_id);
-	if((reqp->type & 0xFF000) == STAMPED)
+}
+
+/* Serialize the service contents into packet (which must hold at least
+   DIS_STAMPED_HEADER + size bytes). The payload is laid out behind a stamped
+   header and the shorter unstamped header sits right in front of the payload
+   (over the unused reserved words), so the same bytes can be sent to any
+   client: only the size and service_id words are filled in per connection
+   by send_service_packet(). copy_swap_buffer_out() does not depend on the
+   client format, the receiver does the swapping. Returns the payload size. */
+
+static int fill_service_packet( DIS_STAMPED_PACKET *packet, SERVICE *servp, 
+							   int *buffp, int size )
+{
+	int aux, i;
+#ifdef WIN32
+	struct timeb timebuf;
+#else
+	struct timeval tv;
+	struct timezone *tz;
+#endif
+	FORMAT_STR format_data_cp[MAX_NAME/4];
+
+	if(!servp->user_secs)
 	{
-		pkt_buffer = ((DIS_STAMPED_PACKET *)Dis_packet)->buffer;
-		header_size = DIS_STAMPED_HEADER;
-		if(!servp->user_secs)
-		{
 #ifdef WIN32
-			ftime(&timebuf);
-			aux = timebuf.millitm;
-			Dis_packet->time_stamp[0] = htovl(aux);
-			Dis_packet->time_stamp[1] = htovl((int)timebuf.time);
+		ftime(&timebuf);
+		aux = timebuf.millitm;
+		packet->time_stamp[0] = htovl(aux);
+		packet->time_stamp[1] = htovl((int)timebuf.time);
 #else
-			tz = 0;
-		        gettimeofday(&tv, tz);
-			aux = (int)tv.tv_usec / 1000;
-			Dis_packet->time_stamp[0] = htovl(aux);
-			Dis_packet->time_stamp[1] = htovl((int)tv.tv_sec);
+		tz = 0;
+	        gettimeofday(&tv, tz);
+		aux = (int)tv.tv_usec / 1000;
+		packet->time_stamp[0] = htovl(aux);
+		packet->time_stamp[1] = htovl((int)tv.tv_sec);
 #endif
-		}
-		else
-		{
-			aux = /*0xc0de0000 |*/ servp->user_millisecs;
-			Dis_packet->time_stamp[0] = htovl(aux);
-			Dis_packet->time_stamp[1] = htovl(servp->user_secs);
-		}
-		Dis_packet->reserved[0] = (int)htovl(0xc0dec0de);
-		Dis_packet->quality = htovl(servp->quality);
 	}
 	else
 	{
-		pkt_buffer = ((DIS_PACKET *)Dis_packet)->buffer;
-		header_size = DIS_HEADER;
+		aux = /*0xc0de0000 |*/ servp->user_millisecs;
+		packet->time_stamp[0] = htovl(aux);
+		packet->time_stamp[1] = htovl(servp->user_secs);
 	}
-	memcpy(format_data_cp, servp->format_data, sizeof(format_data_cp));
-	size = copy_swap_buffer_out(reqp->format, format_data_cp, 
-		pkt_buffer,
-		buffp, size);
-	Dis_packet->size = htovl(header_size + size);
-	if( !dna_write_nowait(conn_id, Dis_packet, header_size + size) ) 
+	packet->reserved[0] = (int)htovl(0xc0dec0de);
+	packet->quality = htovl(servp->quality);
+	if(!buffp && servp->n_segments)
 	{
-		if(Net_conns[conn_id].write_timedout)
+		/* the format needs no swapping: the segments are copied as they are */
+		size = 0;
+		for(i = 0; i < servp->n_segments; i++)
 		{
-			dim_print_date_time();
-			if(reqp->delay_delete > 1)
-			{
-				printf(" Server (Explicitly) Updating Service %s: Couldn't write to Conn %3d : Client %s@%s\n",
-					servp->name, conn_id,
-					Net_conns[conn_id].task, Net_conns[conn_id].node);
-			}
-			else
-			{
-				printf(" Server Updating Service %s: Couldn't write to Conn %3d : Client %s@%s\n",
-					servp->name, conn_id,
-					Net_conns[conn_id].task, Net_conns[conn_id].node);
-			}
-			fflush(stdout);
+			memcpy((char *)packet->buffer + size, servp->segments[i].address,
+				(size_t)servp->segments[i].size);
+			size += servp->segments[i].size;
 		}
+		return(size);
+	}
+	memcpy(format_data_cp, servp->format_data, sizeof(format_data_cp));
+	return copy_swap_buffer_out(0, format_data_cp, 
+		packet->buffer,
+		buffp, size);
+}
+
+/* Set the header of a packet prepared by fill_service_packet() for the client
+   of reqp, returns where to write from and the size to write */
+
+static void *set_service_packet_header( REQUEST *reqp, DIS_STAMPED_PACKET *packet,
+									   int size, int *write_size )
+{
+	register SERVICE *servp;
+	DIS_PACKET *unstamped;
+	int conn_id;
+
+	servp = reqp->service_ptr;
+	conn_id = reqp->conn_id;
+
+if(Debug_on)
+{
+dim_print_date_time();
+printf("Updating %s for %s@%s (req_id = %d)\n",
+	   servp->name, 
+	   Net_conns[conn_id].task, Net_conns[conn_id].node, 
+	   reqp->req_id);
+}
+
+	if((reqp->type & 0xFF000) == STAMPED)
+	{
+		packet->service_id = htovl(reqp->service_id);
+		packet->size = htovl(DIS_STAMPED_HEADER + size);
+		*write_size = DIS_STAMPED_HEADER + size;
+		return(packet);
+	}
+	unstamped = (DIS_PACKET *)((char *)packet->buffer - DIS_HEADER);
+	unstamped->service_id = htovl(reqp->service_id);
+	unstamped->size = htovl(DIS_HEADER + size);
+	*write_size = DIS_HEADER + size;
+	return(unstamped);
+}
+
+/* The client of reqp could not be written to */
+
+static void service_packet_failed( REQUEST *reqp, int conn_id )
+{
+	register SERVICE *servp;
+
+	servp = reqp->service_ptr;
+	if(Net_conns[conn_id].write_timedout)
+	{
+		dim_print_date_time();
 		if(reqp->delay_delete > 1)
 		{
-			reqp->to_delete = 1;
+			printf(" Server (Explicitly) Updating Service %s: Couldn't write to Conn %3d : Client %s@%s\n",
+				servp->name, conn_id,
+				Net_conns[conn_id].task, Net_conns[conn_id].node);
 		}
 		else
 		{
-			reqp->delay_delete = 0;
-			release_conn(conn_id, 1, 0);
+			printf(" Server Updating Service %s: Couldn't write to Conn %3d : Client %s@%s\n",
+				servp->name, conn_id,
+				Net_conns[conn_id].task, Net_conns[conn_id].node);
 		}
+		fflush(stdout);
 	}
+	if(reqp->delay_delete > 1)
+	{
+		reqp->to_delete = 1;
+	}
+	else
+	{
+		reqp->delay_delete = 0;
+		release_conn(conn_id, 1, 0);
+	}
+}
+
+/* Send a packet prepared by fill_service_packet() to the client of reqp */
+
+static int send_service_packet( REQUEST *reqp, DIS_STAMPED_PACKET *packet, int size )
+{
+	void *writep;
+	int conn_id, write_size, ret;
+
+	conn_id = reqp->conn_id;
+	writep = set_service_packet_header(reqp, packet, size, &write_size);
+	ret = dna_write_nowait(conn_id, writep, write_size);
+	if( !ret ) 
+		service_packet_failed(reqp, conn_id);
 /*
 	else
 	{
@@ -1550,11 +1597,75 @@ printf("Updating %s for %s@%s (req_id = %d)\n",
 		}
 	}
 */
+	return(ret);
+}
+
+/* A timeout for a timed or monitored service occured, serve it. */
+
+int execute_service( int req_id )
+{
+	int *buffp, size;
+	register REQUEST *reqp;
+	register SERVICE *servp;
+
+	reqp = (REQUEST *)id_get_ptr(req_id, SRC_DIS);
+	if(!reqp)
+		return(0);
+	if(reqp->to_delete)
+		return(0);
+	reqp->delay_delete++;
+	servp = reqp->service_ptr;
+
+	get_service_data(reqp, &buffp, &size);
+/* send even if no data but not if negative */
+	if( size  < 0)
+	{
+		reqp->delay_delete--;
+		return(0);
+	}
+	if( DIS_STAMPED_HEADER + size > Dis_packet_size ) 
+	{
+		if( Dis_packet_size )
+			free( Dis_packet );
+		Dis_packet = (DIS_STAMPED_PACKET *)malloc((size_t)(DIS_STAMPED_HEADER + size));
+		if(!Dis_packet)
+		{
+			Dis_packet_size = 0;
+			reqp->delay_delete--;
+			return(0);
+		}
+		Dis_packet_size = DIS_STAMPED_HEADER + size;
+	}
+	size = fill_service_packet(Dis_packet, servp, buffp, size);
+	send_service_packet(reqp, Dis_packet, size);
 	if(reqp->delay_delete > 0)
 		reqp->delay_delete--;
 	return(1);
 }
 
+/* Serve one update of a service to several clients: the service contents are
+   fetched and serialized only once, in a packet private to this update since
+   the lock is released between clients. Only for the services whose contents
+   do not depend on the client: no user routine (which may call
+   dis_get_conn_id() to tailor them), or gathered segments.
+   Returns the packet or 0 if the update should not be sent (negative size),
+   in which case *size is negative, or if it could not be allocated. */
+
+static DIS_STAMPED_PACKET *get_shared_packet( REQUEST *reqp, int *size )
+{
+	int *buffp;
+	DIS_STAMPED_PACKET *packet;
+
+	get_service_data(reqp, &buffp, size);
+	if( *size < 0 )
+		return(0);
+	packet = (DIS_STAMPED_PACKET *)malloc((size_t)(DIS_STAMPED_HEADER + *size));
+	if(!packet)
+		return(0);
+	*size = fill_service_packet(packet, reqp->service_ptr, buffp, *size);
+	return(packet);
+}
+
 void remove_service( int req_id )
 {
 	register REQUEST *reqp;
@@ -1696,6 +1807,61 @@ int do_update_service();
 	return(do_update_service(service_id, client_ids));
 }
 
+/* Update a service from a list of segments, gathered directly into the
+   packets instead of being concatenated by the caller first. Only for
+   formats needing no swapping (e.g. "C"). The segments are used during
+   the call only, the service contents stays untouched for later clients.
+   The DIM lock (recursive) is held for the whole update, so that no other
+   update of the same service can pick up these segments. */
+
+static int do_update_service_segments(unsigned service_id, DIS_SEGMENT *segments,
+									  int n_segments, int *client_ids)
+{
+	register SERVICE *servp;
+	FORMAT_STR *formatp;
+	int do_update_service();
+	int ret;
+
+	DISABLE_AST
+	servp = (SERVICE *)id_get_ptr(service_id, SRC_DIS);
+	if(!servp || (servp->id != (int)service_id) || (servp->type == COMMAND) ||
+		(n_segments <= 0))
+	{
+		ENABLE_AST
+		return(0);
+	}
+	for(formatp = servp->format_data; formatp->par_bytes; formatp++)
+	{
+		if((formatp->flags & 0x3) != NOSWAP)
+		{
+			ENABLE_AST
+			return(-1);
+		}
+	}
+	servp->segments = segments;
+	servp->n_segments = n_segments;
+	ret = do_update_service(service_id, client_ids);
+	servp = (SERVICE *)id_get_ptr(service_id, SRC_DIS);
+	if(servp && (servp->id == (int)service_id))
+	{
+		servp->segments = 0;
+		servp->n_segments = 0;
+	}
+	ENABLE_AST
+	return(ret);
+}
+
+int dis_update_service_segments(unsigned service_id, DIS_SEGMENT *segments, int n_segments)
+{
+	return(do_update_service_segments(service_id, segments, n_segments, 0));
+}
+
+int dis_selective_update_service_segments(unsigned service_id, DIS_SEGMENT *segments,
+										  int n_segments, int *client_ids)
+{
+	return(do_update_service_segments(service_id, segments, n_segments, client_ids));
+}
+
 int check_client(REQUEST *reqp, int *client_ids)
 {
 	if(!client_ids)
@@ -1711,6 +1877,11 @@ int check_client(REQUEST *reqp, int *client_ids)
 	return(0);
 }
 
+/* When several clients are to be updated the service contents are serialized
+   once and the same packet is written to every connection, without holding
+   the DIM lock during the writes. Several threads may update the same service
+   at the same time, delay_delete counts the updates in progress. */
+
 int do_update_service(unsigned service_id, int *client_ids)
 {
 	register REQUEST *reqp;
@@ -1722,6 +1893,10 @@ int do_update_service(unsigned service_id, int *client_ids)
 	char str[128];
 	int release_request();
 	int n_clients = 0;
+	DIS_STAMPED_PACKET *shared_packet = 0;
+	int shared_size = 0, shared_done = 0;
+	void *writep;
+	int write_size, ret;
 
 	DISABLE_AST
 	if(Serving == -1)
@@ -1747,7 +1922,7 @@ int do_update_service(unsigned service_id, int *client_ids)
 		ENABLE_AST
 		return(found);
 	}
-	servp->delay_delete = 1;
+	servp->delay_delete++;
 	reqp = servp->request_head;
 	while( (reqp = (REQUEST *) dll_get_next((DLL *)servp->request_head,
 		(DLL *) reqp)) ) 
@@ -1763,7 +1938,7 @@ printf("Updating %s (id = %d, ptr = %08lX) for %s@%s (req_id = %d, req_ptr = %08
 */
 		if(check_client(reqp, client_ids))
 		{
-			reqp->delay_delete = 1;
+			reqp->delay_delete++;
 			n_clients++;
 		}
 	}
@@ -1784,7 +1959,39 @@ printf("Updating %s (id = %d, ptr = %08lX) for %s@%s (req_id = %d, req_ptr = %08
 /*
 				DISABLE_AST
 */
-				execute_service(reqp->req_id);
+				if( (n_clients > 1) && (servp->type != COMMAND) &&
+					(!servp->user_routine || servp->n_segments) &&
+					!reqp->first_time && !reqp->to_delete )
+				{
+					if(!shared_done)
+					{
+						shared_packet = get_shared_packet(reqp, &shared_size);
+						shared_done = 1;
+					}
+					if(shared_packet)
+					{
+						/* reqp and servp are kept by delay_delete, the
+						   connection is checked by dna_write_nowait(), so
+						   the DIM lock is not needed while writing */
+						reqp->delay_delete++;
+						conn_id = reqp->conn_id;
+						writep = set_service_packet_header(reqp, shared_packet,
+							shared_size, &write_size);
+						ENABLE_AST
+						ret = dna_write_nowait(conn_id, writep, write_size);
+						{
+						DISABLE_AST
+						}
+						if(!ret && !reqp->to_delete && (reqp->conn_id == conn_id))
+							service_packet_failed(reqp, conn_id);
+						if(reqp->delay_delete > 0)
+							reqp->delay_delete--;
+					}
+					else if(shared_size >= 0)
+						execute_service(reqp->req_id);
+				}
+				else
+					execute_service(reqp->req_id);
 				found++;
 				ENABLE_AST
 				{
@@ -1794,6 +2001,8 @@ printf("Updating %s (id = %d, ptr = %08lX) for %s@%s (req_id = %d, req_ptr = %08
 		}
 		}
 	}
+	if(shared_packet)
+		free(shared_packet);
 	ENABLE_AST
 	}
 	{
@@ -1804,7 +2013,8 @@ printf("Updating %s (id = %d, ptr = %08lX) for %s@%s (req_id = %d, req_ptr = %08
 	{
 		if(check_client(reqp, client_ids))
 		{
-			reqp->delay_delete = 0;
+			if(reqp->delay_delete > 0)
+				reqp->delay_delete--;
 			if(reqp->to_delete)
 				to_delete = 1;
 		}
@@ -1851,8 +2061,9 @@ printf("Updating %s (id = %d, ptr = %08lX) for %s@%s (req_id = %d, req_ptr = %08
 	}
 	{
 	DISABLE_AST
-	servp->delay_delete = 0;
-	if(servp->to_delete)
+	if(servp->delay_delete > 0)
+		servp->delay_delete--;
+	if(servp->to_delete && !servp->delay_delete)
 	{
 		dis_remove_service(servp->id);
 	}
@@ -3225,31 +3436,16 @@ static void error_handler(int conn_id, int severity, int errcode, char *reason,
 		exit_handler(&exit_tag, &exit_code, &exit_size);
 	}
 }
-/*
-#define MAX_HASH_ENTRIES 2000
-*/
-#define MAX_HASH_ENTRIES 5000
-
-static SERVICE *Service_hash_table[MAX_HASH_ENTRIES];
-static int Service_new_entries[MAX_HASH_ENTRIES];
+static HASH_TABLE Service_hash_table;
 
 int dis_hash_service_init()
 {
 
-  int i;
   static int done = 0;
 
   if(!done)
   {
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
-	{
-/*
-		Service_hash_table[i] = (SERVICE *) malloc(sizeof(SERVICE));
-		dll_init((DLL *) Service_hash_table[i]);
-*/
-		Service_hash_table[i] = 0;
-		Service_new_entries[i] = 0;
-	}
+	hash_table_init(&Service_hash_table, (int)offsetof(SERVICE, name));
 	done = 1;
   }
 
@@ -3258,103 +3454,32 @@ int dis_hash_service_init()
 
 int dis_hash_service_insert(SERVICE *servp)
 {
-	int index;
-	index = HashFunction(servp->name, MAX_HASH_ENTRIES);
-	if(!Service_hash_table[index])
-	{
-		Service_hash_table[index] = (SERVICE *) malloc(sizeof(SERVICE));
-		dll_init((DLL *) Service_hash_table[index]);
-	}
-	Service_new_entries[index]++;
-	dll_insert_queue((DLL *) Service_hash_table[index], 
-			 (DLL *) servp);
+	hash_table_insert(&Service_hash_table, servp);
 	return(1);
 }
 
 int dis_hash_service_registered(int index, SERVICE *servp)
 {
 	servp->registered = 1;
-	Service_new_entries[index]--;
-	if(Service_new_entries[index] < 0)
-		Service_new_entries[index] = 0;
+	hash_table_unmark(&Service_hash_table, index);
 	return 1;
 }
 
 int dis_hash_service_remove(SERVICE *servp)
 {
-	int index;
-	index = HashFunction(servp->name, MAX_HASH_ENTRIES);
-	if(!Service_hash_table[index])
-	{
-		return(0);
-	}
-	dll_remove( (DLL *) servp );
-	return(1);
+	return(hash_table_remove(&Service_hash_table, servp));
 }
 
 
 SERVICE *dis_hash_service_exists(char *name)
 {
-	int index;
-	SERVICE *servp;
-
-	index = HashFunction(name, MAX_HASH_ENTRIES);
-	if(!Service_hash_table[index])
-	{
-		return((SERVICE *)0);
-	}
-	if( (servp = (SERVICE *) dll_search(
-					(DLL *) Service_hash_table[index],
-			      		name, (int)strlen(name)+1)) )
-	{
-		return(servp);
-	}
-	return((SERVICE *)0);
+	return((SERVICE *) hash_table_find(&Service_hash_table, name));
 }			
 
 SERVICE *dis_hash_service_get_next(int *curr_index, SERVICE *prevp, int new_entries)
 {
-	int index;
-	SERVICE *servp = 0;
-/*
-	if(!prevp)
-	{
-		index = -1;
-	}
-*/
-	index = *curr_index;
-	if(index == -1)
-	{
-		index++;
-		prevp = Service_hash_table[index];
-	}
-	if(!prevp)
-	{
-		prevp = Service_hash_table[index];
-	}
-	do
-	{
-		if(prevp)
-		{
-			if((!new_entries) || (Service_new_entries[index] > 0))
-			{
-				servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[index],
-						(DLL *) prevp);
-				if(servp)
-					break;
-			}
-		}
-		index++;
-		if(index == MAX_HASH_ENTRIES)
-		{
-			*curr_index = -1;
-			return((SERVICE *) 0);
-		}
-		prevp = Service_hash_table[index];
-	} while(!servp);
-	*curr_index = index;
-	return(servp);
+	return((SERVICE *) hash_table_get_next(&Service_hash_table, curr_index,
+		prevp, new_entries));
 }
 
 DIS_DNS_CONN *dis_find_dns(dim_long dnsid)
@@ -3404,32 +3529,9 @@ DIS_DNS_CONN *find_dns_by_conn_id(int conn_id)
 
 void dis_print_hash_table()
 {
-	SERVICE *servp;
-	int i;
-	int n_entries, max_entry_index = 0;
-	int max_entries = 0;
-
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
-	{
-		n_entries = 0;
-		servp = Service_hash_table[i];
-		while( (servp = (SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[i],
-						(DLL *) servp)) )
-		{
-			n_entries++;
-			if(n_entries == 1)
-				printf("    Name = %s\n",servp->name);
-		}
-		if(n_entries != 0)
-			printf("HASH[%d] - %d entries\n", i, n_entries);
-		if(n_entries > max_entries)
-		{
-			max_entries = n_entries;
-			max_entry_index = i;
-		}
-	}
-	printf("Maximum : HASH[%d] - %d entries\n", max_entry_index, max_entries);  
+	printf("HASH - %d entries, %d slots, %d deleted\n",
+		Service_hash_table.n_items, Service_hash_table.size,
+		Service_hash_table.n_deleted);  
 	fflush(stdout);
 }
 
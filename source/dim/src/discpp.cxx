@@ -1253,6 +1253,33 @@ int DimService::selectiveUpdateService( void *structure, int size, int *cids )
 	return -1;
 }
 	
+int DimService::updateService( DIS_SEGMENT *segments, int nSegments )
+{
+	if(!itsId)
+		return 0;
+	if( itsType == DisPOINTER)
+		return dis_update_service_segments( itsId, segments, nSegments );
+	return -1;
+}
+
+int DimService::selectiveUpdateService( DIS_SEGMENT *segments, int nSegments, int *cids )
+{
+	if(!itsId)
+		return 0;
+	if( itsType == DisPOINTER)
+	{
+		if( cids == 0)
+		{
+			int ids[2];
+			ids[0] = DimServer::getClientId();
+			ids[1] = 0;
+			return dis_selective_update_service_segments( itsId, segments, nSegments, ids );
+		} 
+		return dis_selective_update_service_segments( itsId, segments, nSegments, cids );
+	}
+	return -1;
+}
+
 void DimService::setQuality(int quality)
 {
 	if(!itsId)
@@ -1573,6 +1600,36 @@ void DimRpc::setData(void *data, int size)
 	storeIt(data,size);
 }
 
+void DimRpc::setData(DIS_SEGMENT *segments, int nSegments)
+{
+	int i, size = 0;
+
+	for(i = 0; i < nSegments; i++)
+		size += segments[i].size;
+	// as storeIt(), but gathering the segments in the output buffer
+	DISABLE_AST
+	if(!itsIdIn)
+	{
+		ENABLE_AST
+		return;
+	}
+	if(itsDataOutSize < size)
+	{
+		if(itsDataOutSize)
+			delete[] (char *)itsDataOut;
+		itsDataOut = new char[size];
+		itsDataOutSize = size;
+	}
+	size = 0;
+	for(i = 0; i < nSegments; i++)
+	{
+		memcpy((char *)itsDataOut + size, segments[i].address, (size_t)segments[i].size);
+		size += segments[i].size;
+	}
+	itsSizeOut = size;
+	ENABLE_AST
+}
+
 void DimRpc::setData(int &data)
 {
 	storeIt(&data,sizeof(int));
@@ -46,195 +46,173 @@ extern int Tcpip_max_io_data_read;
 _DIM_PROTO( static void ast_read_h,     (int conn_id, int status, int size) );
 _DIM_PROTO( static void ast_conn_h,     (int handle, int svr_conn_id,
                                      int protocol) );
-_DIM_PROTO( static int dna_write_bytes, (int conn_id, void *buffer, int size,
-									 int nowait) );
 _DIM_PROTO( static void release_conn,   (int conn_id) );
 _DIM_PROTO( static void save_node_task, (int conn_id, DNA_NET *buffer) );
 
+/*
+ * Locking: the connection and id tables (conn_handler.c), the service and
+ * request tables of dis.c/dic.c and the timer queues are only used with
+ * the DIM lock (DISABLE_AST) held; there is no per service lock, looking a
+ * service up and serving a request are serialized on the DIM lock.
+ * What can take time is done without it: writing to a connection only
+ * needs the connection writer lock (the write queue below and
+ * tcpip_writer_sendv()), and the IO threads read without it (see
+ * do_read_some() in tcpip.c), taking it only to dispatch what they read.
+ */
+
 /*
  * Routines common to Server and Client
  */
 /*
-static int Prev_packet[3];
-static int Prev_buffer[3];
-static int Prev_conn_id = 0;
-*/
-static int is_header( int conn_id )
+ * Incoming data is read into the connection buffer, as much as the
+ * socket has available, between read_head and read_tail. All the complete
+ * packets found there are passed up in place, without copying.
+ * Packets start at DNA_READ_START so that the data following the header
+ * is 8 byte aligned, as it was when every packet was read on its own.
+ */
+#define DNA_READ_START		4
+#define DNA_READ_MIN		1024
+
+static char *Read_align_buffer = 0;
+static int Read_align_size = 0;
+
+static int is_header( int *header )
 {
-	register DNA_CONNECTION *dna_connp = &Dna_conns[conn_id];
 	register int ret;
 
 	ret = 0;
-	if( (vtohl(dna_connp->buffer[2]) == TRP_MAGIC) &&
-	    (vtohl(dna_connp->buffer[1]) == 0) &&
-	    (vtohl(dna_connp->buffer[0]) == READ_HEADER_SIZE) )
+	if( (vtohl(header[2]) == TRP_MAGIC) &&
+	    (vtohl(header[1]) == 0) &&
+	    (vtohl(header[0]) == READ_HEADER_SIZE) )
 	{
-		dna_connp->state = RD_HDR;
-		ret = 1;
+		ret = RD_HDR;
 	} 
-	else if( (vtohl(dna_connp->buffer[2]) == TST_MAGIC) &&
-		   (vtohl(dna_connp->buffer[1]) == 0) &&
-		   (vtohl(dna_connp->buffer[0]) == READ_HEADER_SIZE) )
+	else if( (vtohl(header[2]) == TST_MAGIC) &&
+		   (vtohl(header[1]) == 0) &&
+		   (vtohl(header[0]) == READ_HEADER_SIZE) )
 	{
-		dna_connp->state = RD_HDR;
-		ret = 1;
+		ret = RD_HDR;
 	} 
-	else if( (vtohl(dna_connp->buffer[2]) == (int)HDR_MAGIC ) &&
-		   (vtohl(dna_connp->buffer[0]) == (int)READ_HEADER_SIZE ) )
+	else if( (vtohl(header[2]) == (int)HDR_MAGIC ) &&
+		   (vtohl(header[0]) == (int)READ_HEADER_SIZE ) &&
+		   (vtohl(header[1]) >= 0) )
 	{
-		dna_connp->state = RD_DATA;
-		ret = 1;
+		ret = RD_DATA;
 	} 
-	else 
-	{
-/*
-		dim_print_date_time();
-		printf( " conn: %d to %s@%s, expecting header\n", conn_id,
-			Net_conns[conn_id].task, Net_conns[conn_id].node );
-		printf( "buffer[0]=%d\n", vtohl(dna_connp->buffer[0]));
-		printf( "buffer[1]=%d\n", vtohl(dna_connp->buffer[1]));
-		printf( "buffer[2]=%x\n", vtohl(dna_connp->buffer[2]));
-		printf( "closing the connection.\n" );
-		printf( " Previous conn: %d, Previous Packet\n", Prev_conn_id);
-		printf( "buffer[0]=%d\n", vtohl(Prev_packet[0]));
-		printf( "buffer[1]=%d\n", vtohl(Prev_packet[1]));
-		printf( "buffer[2]=%x\n", vtohl(Prev_packet[2]));
-		printf( " Previous Buffer\n");
-		printf( "buffer[0]=%d\n", vtohl(Prev_buffer[0]));
-		printf( "buffer[1]=%d\n", vtohl(Prev_buffer[1]));
-		printf( "buffer[2]=%x\n", vtohl(Prev_buffer[2]));
-		fflush(stdout);
-*/
-		dna_connp->read_ast(conn_id, NULL, 0, STA_DISC);
-		ret = 0;
-	}			
 	return(ret);
 }
 
-static void read_data( int conn_id)
+static void read_data( int conn_id, int *buffer, int size )
 {
 	register DNA_CONNECTION *dna_connp = &Dna_conns[conn_id];
 
 	if( !dna_connp->saw_init &&
-	    vtohl(dna_connp->buffer[0]) == (int)OPN_MAGIC)
+	    vtohl(buffer[0]) == (int)OPN_MAGIC)
 	{
-		save_node_task(conn_id, (DNA_NET *) dna_connp->buffer);
+		save_node_task(conn_id, (DNA_NET *) buffer);
 		dna_connp->saw_init = TRUE;
 	} 
 	else
 	{
 /*
-printf("passing up %d bytes, conn_id %d\n",dna_connp->full_size, conn_id); 
+printf("passing up %d bytes, conn_id %d\n",size, conn_id); 
 */
-		dna_connp->read_ast(conn_id, dna_connp->buffer,
-			dna_connp->full_size, STA_DATA);
+		dna_connp->read_ast(conn_id, buffer, size, STA_DATA);
+	}
+}
+
+static int *align_data( char *data, int size )
+{
+	/* Packets following one of an odd size are not aligned in the
+	 * connection buffer, pass those up from a copy.
+	 */
+	if(!((dim_long)data & 0x7))
+		return((int *) data);
+	if(size > Read_align_size)
+	{
+		if(Read_align_buffer)
+			free(Read_align_buffer);
+		Read_align_buffer = malloc((size_t)size);
+		Read_align_size = size;
 	}
+	memcpy(Read_align_buffer, data, (size_t)size);
+	return((int *) Read_align_buffer);
 }
 
 static void ast_read_h( int conn_id, int status, int size )
 {
 	register DNA_CONNECTION *dna_connp = &Dna_conns[conn_id];
-	int tcpip_code;
-	register int read_size, next_size;
 	register char *buff;
-	int max_io_data;
+	int header[3];
+	int *buffer, next_size, data_size;
 
 	if(!dna_connp->buffer) /* The connection has already been closed */
 	{
 		return;
 	}
-	if(status == 1)
+	if(status != 1)
 	{
-		next_size = dna_connp->curr_size;
-		buff = (char *) dna_connp->curr_buffer;
-  		if(size < next_size) 
-		{
-/*
-			Prev_conn_id = conn_id;
-	  		Prev_packet[0] = ((int *)dna_connp->curr_buffer)[0];
-			Prev_packet[1] = ((int *)dna_connp->curr_buffer)[1];
-			Prev_packet[2] = ((int *)dna_connp->curr_buffer)[2];
-			Prev_buffer[0] = dna_connp->buffer[0];
-			Prev_buffer[1] = dna_connp->buffer[1];
-			Prev_buffer[2] = dna_connp->buffer[2];
-*/
-			max_io_data = Tcpip_max_io_data_read;
-			read_size = ((next_size - size) > max_io_data) ?
-				max_io_data : next_size - size;
-			dna_connp->curr_size -= size;
-			dna_connp->curr_buffer += size;
-			tcpip_code = tcpip_start_read(conn_id, buff + size, 
-				read_size, ast_read_h);
-			if(tcpip_failure(tcpip_code)) 
-			{
-#ifndef WIN32
-			  if(errno == ENOTSOCK)
-			  {
-				  if(dna_connp->read_ast)
-					dna_connp->read_ast(conn_id, NULL, 0, STA_DISC);
-			  }
-			  else
-#endif
-			  {
-				dna_report_error(conn_id, tcpip_code,
-					"Reading from", DIM_ERROR, DIMTCPRDERR);
-			  }
-			}
-			return;
-		}
-		switch(dna_connp->state)
+	  /*
+	  printf("Connection lost. Signal upper layer\n");
+	  */
+		if(dna_connp->read_ast)
+			dna_connp->read_ast(conn_id, NULL, 0, STA_DISC);
+		return;
+	}
+	dna_connp->read_tail += size;
+	next_size = READ_HEADER_SIZE;
+	while(dna_connp->read_tail - dna_connp->read_head >= READ_HEADER_SIZE)
+	{
+		buff = (char *) dna_connp->buffer + dna_connp->read_head;
+		memcpy(header, buff, (size_t)READ_HEADER_SIZE);
+		switch(is_header(header))
 		{
 			case RD_HDR :
-				if(is_header(conn_id))
+				dna_connp->read_head += READ_HEADER_SIZE;
+				continue;
+			case RD_DATA :
+				data_size = vtohl(header[1]);
+				if(dna_connp->read_tail - dna_connp->read_head <
+					READ_HEADER_SIZE + data_size)
 				{
-					if( dna_connp->state == RD_DATA )
-					{
-						next_size = vtohl(dna_connp->buffer[1]);
-						dna_start_read(conn_id, next_size);
-					}
-					else
-					{
-						dna_connp->state = RD_HDR;
-						dna_start_read(conn_id, READ_HEADER_SIZE);
-					}
+					next_size = READ_HEADER_SIZE + data_size;
+					break;
 				}
-				break;
-			case RD_DATA :
-				read_data(conn_id);
-				dna_connp->state = RD_HDR;
-				dna_start_read(conn_id, READ_HEADER_SIZE);
-				break;
-			default:
-				break;
-		}
+				dna_connp->read_head += READ_HEADER_SIZE + data_size;
+				buffer = align_data(buff + READ_HEADER_SIZE, data_size);
+				read_data(conn_id, buffer, data_size);
+				/* The callback may have closed the connection (or
+				 * reallocated the connection table) */
+				dna_connp = &Dna_conns[conn_id];
+				if(!dna_connp->busy || !dna_connp->buffer)
+					return;
+				continue;
+			default :
 /*
-		if(dna_connp->buffer)
-		{
-			Prev_conn_id = conn_id;
-			Prev_packet[0] = ((int *)dna_connp->curr_buffer)[0];
-			Prev_packet[1] = ((int *)dna_connp->curr_buffer)[1];
-			Prev_packet[2] = ((int *)dna_connp->curr_buffer)[2];
-			Prev_buffer[0] = dna_connp->buffer[0];
-			Prev_buffer[1] = dna_connp->buffer[1];
-			Prev_buffer[2] = dna_connp->buffer[2];
-		}
+				dim_print_date_time();
+				printf( " conn: %d to %s@%s, expecting header\n", conn_id,
+					Net_conns[conn_id].task, Net_conns[conn_id].node );
+				printf( "buffer[0]=%d\n", vtohl(header[0]));
+				printf( "buffer[1]=%d\n", vtohl(header[1]));
+				printf( "buffer[2]=%x\n", vtohl(header[2]));
+				printf( "closing the connection.\n" );
+				fflush(stdout);
 */
-	} 
-	else 
-	{
-	  /*
-	  printf("Connection lost. Signal upper layer\n");
-	  */
-		if(dna_connp->read_ast)
-			dna_connp->read_ast(conn_id, NULL, 0, STA_DISC);
+				dna_connp->read_ast(conn_id, NULL, 0, STA_DISC);
+				return;
+		}
+		break;
 	}
+	dna_start_read(conn_id, next_size);
 }
 
 
 int dna_start_read(int conn_id, int size)
 {
+	/* Read whatever is available after the data already in the buffer,
+	 * making room for size bytes from the read head. */
 	register DNA_CONNECTION *dna_connp = &Dna_conns[conn_id];
-	register int tcpip_code, read_size;
+	register int tcpip_code, read_size, used;
 	int max_io_data;
 	
 	if(!dna_connp->busy)
@@ -242,19 +220,34 @@ int dna_start_read(int conn_id, int size)
 		return(0);
 	}
 
-	dna_connp->curr_size = size;
-	dna_connp->full_size = size;
-	if(size > dna_connp->buffer_size) 
+	used = dna_connp->read_tail - dna_connp->read_head;
+	if(!used)
+	{
+		dna_connp->read_head = DNA_READ_START;
+		dna_connp->read_tail = DNA_READ_START;
+	}
+	else if((dna_connp->read_head + size > dna_connp->buffer_size) ||
+		(dna_connp->buffer_size - dna_connp->read_tail < DNA_READ_MIN))
+	{
+		memmove((char *) dna_connp->buffer + DNA_READ_START,
+			(char *) dna_connp->buffer + dna_connp->read_head, (size_t)used);
+		dna_connp->read_head = DNA_READ_START;
+		dna_connp->read_tail = DNA_READ_START + used;
+	}
+	if(DNA_READ_START + size > dna_connp->buffer_size) 
 	{
 		dna_connp->buffer =
-				(int *) realloc(dna_connp->buffer, (size_t)size);
-		dna_connp->buffer_size = size;
+				(int *) realloc(dna_connp->buffer, (size_t)(DNA_READ_START + size));
+		dna_connp->buffer_size = DNA_READ_START + size;
 	}
-	dna_connp->curr_buffer = (char *) dna_connp->buffer;
+	dna_connp->curr_buffer = (char *) dna_connp->buffer + dna_connp->read_tail;
+	dna_connp->curr_size = dna_connp->buffer_size - dna_connp->read_tail;
+	dna_connp->full_size = size;
 	max_io_data = Tcpip_max_io_data_read;
-	read_size = (size > max_io_data) ? max_io_data : size ;
+	read_size = (dna_connp->curr_size > max_io_data) ?
+		max_io_data : dna_connp->curr_size;
 
-	tcpip_code = tcpip_start_read(conn_id, dna_connp->curr_buffer,
+	tcpip_code = tcpip_start_read_some(conn_id, dna_connp->curr_buffer,
 				  read_size, ast_read_h);
 	if(tcpip_failure(tcpip_code)) {
 		dna_report_error(conn_id, tcpip_code,
@@ -267,68 +260,27 @@ int dna_start_read(int conn_id, int size)
 }								
 
 
-static int dna_write_bytes( int conn_id, void *buffer, int size, int nowait )
+static int dna_write_status( int conn_id, int ret, int nowait )
 {
-	register int size_left, wrote;
-	register char *p;
-	int max_io_data;
-#ifdef VMS
-	int retries = WRITE_RETRIES, retrying = 0;
-	float wait_time = 0.01;
-#endif
-	extern int tcpip_write_nowait(int, char *, int);
-
-	max_io_data = Tcpip_max_io_data_write;
-	p = (char *) buffer;
-	size_left = size;
-	do {
-		size = (size_left > max_io_data) ? max_io_data : size_left ;
-#ifdef VMS
-		if(nowait)
-		{
-			while(--retries)
-			{
-				if((wrote = tcpip_write_nowait(conn_id, p, size)) > 0)
-					break;
-				if(!tcpip_would_block(wrote))
-					return(0);
-				if(retries == WRITE_RETRIES_WNG)
-				{
-					dna_report_error(conn_id, tcpip_code,
-						"Writing to (retrying)", DIM_WARNING, DIMTCPWRRTY);
-					retrying = 1;
-				}
-				lib$wait(&wait_time);
-			}
-			if(!retries)
-			{
-				return(0);
-			}
-		}
-		else
-			wrote = tcpip_write(conn_id, p, size);
-#else
+	/* Report the outcome of tcpip_writer_sendv(), with the DIM lock held
+	 */
+	if(ret == -1)
+	{
+		Net_conns[conn_id].write_timedout = 1;
+		dna_report_error(conn_id, -1,
+			"Write timeout, writing to", DIM_WARNING, DIMTCPWRTMO);
+		return(0);
+	}
+	if(!ret)
+	{
 		if(nowait)
-		{
-		  wrote = tcpip_write_nowait(conn_id, p, size);
-		  if(wrote == -1)
-		  {
-		    dna_report_error(conn_id, -1,
-				     "Write timeout, writing to", DIM_WARNING, DIMTCPWRTMO);
-		    wrote = 0;
-		  }
-		}
+			dna_report_error(conn_id, 0,
+				"Writing (non-blocking) to", DIM_ERROR, DIMTCPWRRTY);
 		else
-		{
-			wrote = tcpip_write(conn_id, p, size);
-		}
-#endif
-		
-		if( tcpip_failure(wrote) )
-			return(0);
-		p += wrote;
-		size_left -= wrote;
-	} while(size_left > 0);
+			dna_report_error(conn_id, 0,
+				"Writing (blocking) to", DIM_ERROR, DIMTCPWRRTY);
+		return(0);
+	}
 	return(1);
 }
 
@@ -338,19 +290,28 @@ void dna_test_write(int conn_id)
 	register int tcpip_code;
 	DNA_HEADER test_pkt;
 	register DNA_HEADER *test_p = &test_pkt;
+	TCPIP_IOVEC iov;
+	void *writer;
+	int gen;
 
 	if(!dna_connp->busy)
 	{
 		return;
     }
-	if(dna_connp->writing)
+	if(dna_connp->writing || dna_connp->write_pending)
 	{
 		return;
     }
 	test_p->header_size = htovl(READ_HEADER_SIZE);
 	test_p->data_size = 0;
 	test_p->header_magic = htovl(TST_MAGIC);
-	tcpip_code = dna_write_bytes(conn_id, &test_pkt, READ_HEADER_SIZE,0);
+	iov.base = (char *)&test_pkt;
+	iov.size = READ_HEADER_SIZE;
+	writer = tcpip_get_writer(conn_id, &gen);
+	tcpip_code = tcpip_writer_sendv(writer, gen, &iov, 1, 0);
+	if(tcpip_code == 2)
+		return;
+	tcpip_code = dna_write_status(conn_id, tcpip_code, 0);
 	if(tcpip_failure(tcpip_code)) {
 		 /* Connection lost. Signal upper layer ? */
 		if(dna_connp->read_ast)
@@ -359,62 +320,255 @@ void dna_test_write(int conn_id)
 	}
 }
 
-typedef struct
+/* Data queued by dna_write() is copied into chunks, kept per connection in
+ * write_queue/write_last. Chunks come from the connection's spare one, a
+ * pool of free chunks or malloc (and packets bigger than a chunk get one of
+ * their own). All this is protected by the DIM lock, but do_dna_write() takes
+ * the chunks off the queue while writing them.
+ * do_dna_write() can stop in the middle of a packet, so as long as
+ * write_pending is set everything written to the connection goes through
+ * the queue: dna_write_nowait() queues its packet and test writes are
+ * skipped.
+ */
+typedef struct write_chunk
 {
-	int conn_id;
-	void *buffer;
+	struct write_chunk *next;
 	int size;
-	char dummy[MAX_NAME];
-} WRITE_ITEM;
+	int head;
+	int tail;
+	char data[1];
+} WRITE_CHUNK;
+
+#define DNA_CHUNK_SIZE		(16*1024)
+#define DNA_MAX_FREE_CHUNKS	64
+#define DNA_MAX_IOV			64		/* Chunks written at once */
+
+static WRITE_CHUNK *Free_chunks = 0;
+static int N_free_chunks = 0;
 
-static int do_dna_write(int id)
+static WRITE_CHUNK *get_chunk(DNA_CONNECTION *dna_connp, int size)
 {
-	register DNA_CONNECTION *dna_connp;
-	int tcpip_code;
-	WRITE_ITEM *ptr;
-	int conn_id, size;
-	void *buffer;
+	WRITE_CHUNK *chunkp;
 
-	ptr = (WRITE_ITEM *)id_get_ptr(id, SRC_DNA);
-	if(!ptr)
-		return(2);
-	conn_id = ptr->conn_id;
-	buffer = ptr->buffer;
-	size = ptr->size;
+	if(size > DNA_CHUNK_SIZE)
+	{
+		chunkp = (WRITE_CHUNK *)malloc(sizeof(WRITE_CHUNK) + (size_t)size);
+		if(!chunkp)
+			return(0);
+		chunkp->size = size;
+	}
+	else if(dna_connp->write_spare)
+	{
+		chunkp = (WRITE_CHUNK *)dna_connp->write_spare;
+		dna_connp->write_spare = 0;
+	}
+	else if(Free_chunks)
+	{
+		chunkp = Free_chunks;
+		Free_chunks = chunkp->next;
+		N_free_chunks--;
+	}
+	else
+	{
+		chunkp = (WRITE_CHUNK *)malloc(sizeof(WRITE_CHUNK) + DNA_CHUNK_SIZE);
+		if(!chunkp)
+			return(0);
+		chunkp->size = DNA_CHUNK_SIZE;
+	}
+	chunkp->next = 0;
+	chunkp->head = 0;
+	chunkp->tail = 0;
+	return(chunkp);
+}
+
+static void put_chunk(DNA_CONNECTION *dna_connp, WRITE_CHUNK *chunkp)
+{
+	if(chunkp->size != DNA_CHUNK_SIZE)
+		free(chunkp);
+	else if(dna_connp && !dna_connp->write_spare)
+		dna_connp->write_spare = chunkp;
+	else if(N_free_chunks < DNA_MAX_FREE_CHUNKS)
+	{
+		chunkp->next = Free_chunks;
+		Free_chunks = chunkp;
+		N_free_chunks++;
+	}
+	else
+		free(chunkp);
+}
+
+static void free_write_queue(WRITE_CHUNK *chunkp)
+{
+	WRITE_CHUNK *nextp;
 
+	while(chunkp)
+	{
+		nextp = chunkp->next;
+		put_chunk(0, chunkp);
+		chunkp = nextp;
+	}
+}
+
+static void do_dna_write(int conn_id)
+{
+	/* Write the data queued for conn_id by dna_write(). If the IO thread
+	 * called us because the socket is writable, write only what it takes
+	 * and wait for it to be writable again for the rest.
+	 */
+	register DNA_CONNECTION *dna_connp;
+	int tcpip_code = 1;
+	WRITE_CHUNK *chunkp, *queuep, *lastp;
+	TCPIP_IOVEC iov[DNA_MAX_IOV];
+	int n, gen, event, written, left;
+	void *writer;
+
+	DISABLE_AST
 	dna_connp = &Dna_conns[conn_id];
-	if(!dna_connp->busy)
+	queuep = (WRITE_CHUNK *)dna_connp->write_queue;
+	if(!dna_connp->busy || !queuep)
 	{
-		id_free(id, SRC_DNA);
-		free(buffer);
-		free(ptr);
-		return(2);
+		dna_connp->write_pending = 0;
+		ENABLE_AST
+		return;
     }
-	dna_connp->writing = TRUE;
-	tcpip_code = dna_write_bytes(conn_id, buffer, size,0);
-	if(tcpip_failure(tcpip_code)) 
-	{
-		dna_connp->writing = FALSE;
-		id_free(id, SRC_DNA);
-		free(buffer);
-		free(ptr);
-		return(0);
+	dna_connp->write_queue = 0;
+	dna_connp->write_last = 0;
+	event = dna_connp->write_event;
+	dna_connp->writing++;
+	writer = tcpip_get_writer(conn_id, &gen);
+	ENABLE_AST
+	chunkp = queuep;
+	while(chunkp && (tcpip_code == 1))
+	{
+		for(n = 0, lastp = chunkp; lastp && (n < DNA_MAX_IOV); n++, lastp = lastp->next)
+		{
+			iov[n].base = lastp->data + lastp->head;
+			iov[n].size = lastp->tail - lastp->head;
+		}
+		if(event)
+			tcpip_code = tcpip_writer_sendv_some(writer, gen, iov, n, &written);
+		else
+		{
+			tcpip_code = tcpip_writer_sendv(writer, gen, iov, n, 0);
+			written = -1;
+		}
+		if(tcpip_code != 1)
+			break;
+		if(written == -1)
+		{
+			chunkp = lastp;
+			continue;
+		}
+		/* skip what was written, stop if not all of it */
+		for( ; chunkp != lastp; chunkp = chunkp->next)
+		{
+			left = chunkp->tail - chunkp->head;
+			if(written < left)
+			{
+				chunkp->head += written;
+				break;
+			}
+			written -= left;
+		}
+		if(chunkp != lastp)
+			break;
 	}
+	{
+	DISABLE_AST
+	dna_connp = &Dna_conns[conn_id];
+	if(!tcpip_is_writer(conn_id, writer, gen))
+	{
+		/* the connection was closed (and maybe reused) meanwhile */
+		free_write_queue(queuep);
+		ENABLE_AST
+		return;
+	}
+	dna_connp->writing--;
+	if(tcpip_code != 1)
+	{
+		free_write_queue(queuep);
+		dna_connp->write_pending = 0;
+		if(tcpip_code != 2)
+			dna_write_status(conn_id, tcpip_code, 0);
+		ENABLE_AST
+		return;
+	}
+	/* give back the chunks written, requeue the rest in front */
+	while(queuep != chunkp)
+	{
+		lastp = queuep->next;
+		put_chunk(dna_connp, queuep);
+		queuep = lastp;
+	}
+	if(chunkp)
+	{
+		for(lastp = chunkp; lastp->next; lastp = lastp->next)
+			;
+		lastp->next = (WRITE_CHUNK *)dna_connp->write_queue;
+		if(!dna_connp->write_queue)
+			dna_connp->write_last = lastp;
+		dna_connp->write_queue = chunkp;
+	}
+	if(dna_connp->write_queue)
+		dna_connp->write_event = tcpip_start_write(conn_id, do_dna_write);
+	else
+		dna_connp->write_pending = 0;
+	ENABLE_AST
+	}
+}	
 
-	id_free(id, SRC_DNA);
-	free(buffer);
-	free(ptr);
+static int queue_packet(int conn_id, void *buffer, int size)
+{
+	/* Add a packet to the write queue of conn_id (with the DIM lock held)
+	 */
+	register DNA_CONNECTION *dna_connp;
+	WRITE_CHUNK *chunkp;
+	DNA_HEADER header_pkt;
+	register DNA_HEADER *header_p = &header_pkt;
 
-	dna_connp->writing = FALSE;
+	dna_connp = &Dna_conns[conn_id];
+	chunkp = (WRITE_CHUNK *)dna_connp->write_last;
+	if(!chunkp || (chunkp->size - chunkp->tail < READ_HEADER_SIZE + size))
+	{
+		chunkp = get_chunk(dna_connp, READ_HEADER_SIZE + size);
+		if(!chunkp)
+		{
+			dna_report_error(conn_id, 0,
+				"Queueing a write (out of memory) to", DIM_ERROR, DIMTCPWRRTY);
+			return(0);
+		}
+		if(dna_connp->write_last)
+			((WRITE_CHUNK *)dna_connp->write_last)->next = chunkp;
+		else
+			dna_connp->write_queue = chunkp;
+		dna_connp->write_last = chunkp;
+	}
+	header_p->header_size = htovl(READ_HEADER_SIZE);
+	header_p->data_size = htovl(size);
+	header_p->header_magic = (int)htovl(HDR_MAGIC);
+	memcpy(chunkp->data + chunkp->tail, (char *)header_p, READ_HEADER_SIZE);
+	memcpy(chunkp->data + chunkp->tail + READ_HEADER_SIZE, (char *)buffer, (size_t)size);
+	chunkp->tail += READ_HEADER_SIZE + size;
+	if(!dna_connp->write_pending)
+	{
+		dna_connp->write_pending = 1;
+		dna_connp->write_event = tcpip_start_write(conn_id, do_dna_write);
+	}
 	return(1);
-}	
+}
 
 int dna_write_nowait(int conn_id, void *buffer, int size)
 {
+	/* The write itself is done without the DIM lock (if the caller does not
+	 * hold it), only the connection writer is locked, so a slow client
+	 * does not stop all other DIM activity.
+	 */
 	register DNA_CONNECTION *dna_connp;
 	DNA_HEADER header_pkt;
 	register DNA_HEADER *header_p = &header_pkt;
-	int tcpip_code, ret = 1;
+	TCPIP_IOVEC iov[2];
+	int tcpip_code, ret, gen;
+	void *writer;
 
 	DISABLE_AST
 	dna_connp = &Dna_conns[conn_id];
@@ -423,60 +577,55 @@ int dna_write_nowait(int conn_id, void *buffer, int size)
 		ENABLE_AST
 		return(2);
     }
-	dna_connp->writing = TRUE;
+	if(dna_connp->write_pending)
+	{
+		/* queued data (maybe half a packet) has to go first */
+		ret = queue_packet(conn_id, buffer, size);
+		ENABLE_AST
+		return(ret);
+	}
+	dna_connp->writing++;
+	writer = tcpip_get_writer(conn_id, &gen);
 
 	header_p->header_size = htovl(READ_HEADER_SIZE);
 	header_p->data_size = htovl(size);
 	header_p->header_magic = (int)htovl(HDR_MAGIC);
-	tcpip_code = dna_write_bytes(conn_id, &header_pkt, READ_HEADER_SIZE, 1);
-	if(tcpip_failure(tcpip_code)) 
+	ENABLE_AST
+	/* header and data in a single system call */
+	iov[0].base = (char *)&header_pkt;
+	iov[0].size = READ_HEADER_SIZE;
+	iov[1].base = (char *)buffer;
+	iov[1].size = size;
+	tcpip_code = tcpip_writer_sendv(writer, gen, iov, 2, 1);
 	{
-		dna_connp->writing = FALSE;
-		ENABLE_AST
-		return(0);
-	}
-	tcpip_code = dna_write_bytes(conn_id, buffer, size, 1);
-	if(tcpip_failure(tcpip_code)) 
+	DISABLE_AST
+	dna_connp = &Dna_conns[conn_id];
+	if(!tcpip_is_writer(conn_id, writer, gen))
 	{
-		ret = 0;
+		/* the connection was closed (and maybe reused) meanwhile */
+		ENABLE_AST
+		return(2);
 	}
-	dna_connp->writing = FALSE;
+	dna_connp->writing--;
+	ret = 1;
+	if(tcpip_code != 1)
+		ret = dna_write_status(conn_id, tcpip_code, 1);
 	ENABLE_AST
+	}
 	return(ret);
 }	
 
-typedef struct
-{
-	DNA_HEADER header;
-	char data[1];
-
-}WRITE_DATA;
-
 int dna_write(int conn_id, void *buffer, int size)
 {
-	WRITE_ITEM *newp;
-	int id;
-	WRITE_DATA *pktp;
-	DNA_HEADER *headerp;
+	/* Queue the packet, it is written (together with the others queued
+	 * meanwhile) when the connection can be written to
+	 */
+	int ret;
 
 	DISABLE_AST
-
-	pktp = malloc((size_t)(READ_HEADER_SIZE+size));
-	headerp = &(pktp->header);
-	headerp->header_size = htovl(READ_HEADER_SIZE);
-	headerp->data_size = htovl(size);
-	headerp->header_magic = (int)htovl(HDR_MAGIC);
-
-	memcpy(pktp->data, (char *)buffer, (size_t)size);
-
-	newp = malloc(sizeof(WRITE_ITEM));
-	newp->conn_id = conn_id;
-	newp->buffer = pktp;
-	newp->size = size+READ_HEADER_SIZE;
-	id = id_get((void *)newp, SRC_DNA);
-	dtq_start_timer(0, do_dna_write, id);
+	ret = queue_packet(conn_id, buffer, size);
 	ENABLE_AST
-	return(1);
+	return(ret);
 }
 
 /* Server Routines */
@@ -513,6 +662,7 @@ static void ast_conn_h(int handle, int svr_conn_id, int protocol)
 		}
 */
 		dna_connp->buffer_size = TCP_RCV_BUF_SIZE;
+		dna_connp->read_head = dna_connp->read_tail = DNA_READ_START;
 		dna_connp->read_ast = Dna_conns[svr_conn_id].read_ast;
 		dna_connp->saw_init = FALSE;
 		dna_start_read(conn_id, READ_HEADER_SIZE); /* sizeof(DNA_NET) */
@@ -812,6 +962,7 @@ int dna_open_client(char *server_node, char *server_task, int port, int server_p
 	}
 */
 	dna_connp->buffer_size = TCP_RCV_BUF_SIZE;
+	dna_connp->read_head = dna_connp->read_tail = DNA_READ_START;
 	dna_connp->read_ast = read_ast;
 	dna_connp->saw_init = TRUE;	/* we send it! */
 	dna_start_read(conn_id, READ_HEADER_SIZE);
@@ -858,6 +1009,15 @@ static void release_conn(int conn_id)
 	if(dna_connp->busy)
 	{ 
 		tcpip_close(conn_id);
+		free_write_queue((WRITE_CHUNK *)dna_connp->write_queue);
+		dna_connp->write_queue = 0;
+		dna_connp->write_last = 0;
+		dna_connp->write_pending = 0;
+		if(dna_connp->write_spare)
+		{
+			put_chunk(0, (WRITE_CHUNK *)dna_connp->write_spare);
+			dna_connp->write_spare = 0;
+		}
 		if(dna_connp->buffer)
 		{
 			free(dna_connp->buffer);
@@ -11,16 +11,13 @@
 
 #define DNS
 #include <stdio.h>
+#include <stddef.h>
 #include <dim.h>
 #include <dis.h>
 
 #ifndef WIN32
 #include <netdb.h>
 #endif
-/*
-#define MAX_HASH_ENTRIES 5000
-*/
-#define MAX_HASH_ENTRIES 25000
 FILE	*foutptr;
 
 typedef struct node {
@@ -68,7 +65,7 @@ typedef struct red_serv {
 } RED_DNS_SERVICE;
 
 static DNS_SERVICE **Service_info_list;
-static RED_DNS_SERVICE *Service_hash_table[MAX_HASH_ENTRIES];
+static HASH_TABLE Service_hash_table;
 static int Curr_n_services = 0;
 static int Curr_n_servers = 0;
 static int Last_conn_id;
@@ -1619,22 +1616,13 @@ void kill_servers(int *tag, int *code, int *size)
 
 void service_init()
 {
-  int i;
-
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) {
-		Service_hash_table[i] = (RED_DNS_SERVICE *) malloc(sizeof(RED_DNS_SERVICE));
-		dll_init((DLL *) Service_hash_table[i]);
-	}
+	hash_table_init(&Service_hash_table, (int)offsetof(RED_DNS_SERVICE, serv_name));
 }
 
 
 void service_insert(RED_DNS_SERVICE *servp)
 {
-	int index;
-
-	index = HashFunction(servp->serv_name, MAX_HASH_ENTRIES);
-	dll_insert_queue((DLL *) Service_hash_table[index], 
-			 (DLL *) servp);
+	hash_table_insert(&Service_hash_table, servp);
 }
 
 
@@ -1642,20 +1630,16 @@ void service_remove(RED_DNS_SERVICE *servp)
 {
 	if( servp->node_head )
 		free( servp->node_head );
-	dll_remove( (DLL *) servp );
+	hash_table_remove(&Service_hash_table, servp);
 }
 
 
 DNS_SERVICE *service_exists(char *name)
 {
-	int index;
 	RED_DNS_SERVICE *servp;
 	char *ptr;
 
-	index = HashFunction(name, MAX_HASH_ENTRIES);
-	if( (servp = (RED_DNS_SERVICE *) dll_search(
-					(DLL *) Service_hash_table[index],
-			      		name, (int)strlen(name)+1)) )
+	if( (servp = (RED_DNS_SERVICE *) hash_table_find(&Service_hash_table, name)) )
 	{
 		ptr = (char *)servp - (2 * sizeof(void *));
 		return((DNS_SERVICE *)ptr);
@@ -1666,12 +1650,10 @@ DNS_SERVICE *service_exists(char *name)
 
 void print_hash_table()
 {
-	int i;
+#ifdef VMS
+	int hash_index;
 	RED_DNS_SERVICE *servp;
-	int n_entries, max_entry_index = 0;
-	int max_entries = 0;
 
-#ifdef VMS
 	if( ( foutptr = fopen( "scratch$week:[cp_operator]dim_dns.log", "w" ) 
 		) == (FILE *)0 )
 	{
@@ -1679,46 +1661,25 @@ void print_hash_table()
 		fflush(stdout);
 		return;
 	}	
-#endif								 
-	
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
+	hash_index = -1;
+	servp = 0;
+	while( (servp = (RED_DNS_SERVICE *) hash_table_get_next(
+					&Service_hash_table, &hash_index, servp, 0)) )
 	{
-		n_entries = 0;
-#ifdef VMS
-		fprintf(foutptr,"HASH[%d] : \n",i);
-#endif								 
-		servp = Service_hash_table[i];
-		while( (servp = (RED_DNS_SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[i],
-						(DLL *) servp)) )
-		{
-#ifdef VMS
-			fprintf(foutptr,"%s\n",servp->serv_name);
-#endif								 
-			n_entries++;
-		}
-#ifdef VMS
-		fprintf(foutptr,"\n\n");
-#endif								 
-		if(n_entries != 0)
-			printf("HASH[%d] - %d entries\n", i, n_entries);  
-		if(n_entries > max_entries)
-		{
-			max_entries = n_entries;
-			max_entry_index = i;
-		}
+		fprintf(foutptr,"HASH[%d] : %s\n", hash_index, servp->serv_name);
 	}
-#ifdef VMS
 	fclose(foutptr);
 #endif								 
-	printf("Maximum : HASH[%d] - %d entries\n", max_entry_index, max_entries);  
+	printf("HASH - %d entries, %d slots, %d deleted\n",
+		Service_hash_table.n_items, Service_hash_table.size,
+		Service_hash_table.n_deleted);  
 	fflush(stdout);
 }
 
 int find_services(char *wild_name)
 {
 
-	int i;
+	int hash_index;
 	RED_DNS_SERVICE *servp;
 	DNS_SERVICE *servp1;
 	char tmp[MAX_NAME], *ptr, *ptr1, *dptr, *dptr1;
@@ -1741,80 +1702,77 @@ int find_services(char *wild_name)
 		}
 		return 0;
 	}
-	for( i = 0; i < MAX_HASH_ENTRIES; i++ ) 
+	hash_index = -1;
+	servp = 0;
+	while( (servp = (RED_DNS_SERVICE *) hash_table_get_next(
+					&Service_hash_table, &hash_index, servp, 0)) )
 	{
-		servp = Service_hash_table[i];
-		while( (servp = (RED_DNS_SERVICE *) dll_get_next(
-						(DLL *) Service_hash_table[i],
-						(DLL *) servp)) )
-		{
-			ptr = wild_name;
-			dptr = servp->serv_name;
-			match = 1;
+		ptr = wild_name;
+		dptr = servp->serv_name;
+		match = 1;
 
-            while( (ptr1 = strchr(ptr,'*')) )
+		while( (ptr1 = strchr(ptr,'*')) )
+		{
+			if(ptr1 == ptr)
 			{
-				if(ptr1 == ptr)
+				ptr++;
+				if(!*ptr)
 				{
-					ptr++;
-					if(!*ptr)
-					{
-						dptr = ptr; 
-						break;
-					}
-					strcpy(tmp,ptr);
-					if( (ptr1 = strchr(ptr,'*')) )
-					{
-						tmp[ptr1-ptr] = '\0';
-					}
-					if( (dptr1 = strstr(dptr, tmp)) )
+					dptr = ptr; 
+					break;
+				}
+				strcpy(tmp,ptr);
+				if( (ptr1 = strchr(ptr,'*')) )
+				{
+					tmp[ptr1-ptr] = '\0';
+				}
+				if( (dptr1 = strstr(dptr, tmp)) )
+				{
+					if(!ptr1)
 					{
-						if(!ptr1)
-						{
-							dptr = dptr1;
-							break;
-						}
-						dptr1 += (int)strlen(tmp);
-						ptr = ptr1;
 						dptr = dptr1;
-					}
-					else
-					{
-						match = 0;
 						break;
 					}
+					dptr1 += (int)strlen(tmp);
+					ptr = ptr1;
+					dptr = dptr1;
 				}
 				else
 				{
-					strcpy(tmp,ptr);
-					tmp[ptr1-ptr] = '\0';
-					if(!strncmp(dptr, tmp, strlen(tmp)))
-					{
-						dptr += (int)strlen(tmp);
-						ptr = ptr1;
-					}
-					else
-					{
-						match = 0;
-						break;
-					}
+					match = 0;
+					break;
 				}
-			}			
-			if(strcmp(dptr, ptr))
+			}
+			else
 			{
 				strcpy(tmp,ptr);
-				strcat(tmp,"/RpcIn");
-				if(strcmp(dptr, tmp))
+				tmp[ptr1-ptr] = '\0';
+				if(!strncmp(dptr, tmp, strlen(tmp)))
+				{
+					dptr += (int)strlen(tmp);
+					ptr = ptr1;
+				}
+				else
+				{
 					match = 0;
+					break;
+				}
 			}
-		    if(match)
+		}
+		if(strcmp(dptr, ptr))
+		{
+			strcpy(tmp,ptr);
+			strcat(tmp,"/RpcIn");
+			if(strcmp(dptr, tmp))
+				match = 0;
+		}
+		if(match)
+		{
+			if(servp->state == 1)
 			{
-				if(servp->state == 1)
-				{
-					ptr = (char *)servp - (2 * sizeof(void *));
-					Service_info_list[count] = (DNS_SERVICE *)ptr;
-					count++;
-				}
+				ptr = (char *)servp - (2 * sizeof(void *));
+				Service_info_list[count] = (DNS_SERVICE *)ptr;
+				count++;
 			}
 		}
 	}
@@ -32,42 +32,71 @@ int DIM_Threads_OFF = 1;
 #define SPECIAL_QUEUE		16	/* The queue for the queue-less */
 #define WRITE_QUEUE			17 
 
+/*
+ * The timers are kept in a hierarchical timing wheel: WHEEL_SIZE slots of
+ * one tick, then two levels of LEVEL_SIZE slots covering WHEEL_SIZE and
+ * WHEEL_SIZE*LEVEL_SIZE ticks each, whose entries are moved down
+ * ("cascaded") when their time comes closer. Adding, clearing and
+ * removing an entry is O(1), dtq_stop_timer() finds its entry through
+ * a table by tag. Entries are taken from a pool.
+ * The WRITE_QUEUE entries (time 0) are not timers, they are called as
+ * soon as possible, in order, without the DIM lock.
+ */
+#define DTQ_TICK_MS			100
+#define DTQ_TICKS_PER_SEC	(1000 / DTQ_TICK_MS)
+#define WHEEL_BITS			8
+#define WHEEL_SIZE			(1 << WHEEL_BITS)
+#define WHEEL_MASK			(WHEEL_SIZE - 1)
+#define LEVEL_BITS			6
+#define LEVEL_SIZE			(1 << LEVEL_BITS)
+#define LEVEL_MASK			(LEVEL_SIZE - 1)
+#define WHEEL_MAX_TICKS		(1 << (WHEEL_BITS + 2 * LEVEL_BITS))
+#define DTQ_POOL_BLOCK		256
+#define MAX_WRITE_BATCH		1000
+#define DTQ_TAG_BUCKETS		256		/* dtq_start_timer() entries by tag */
+
+#if defined(__linux__) && !defined(DIM_NO_TIMERFD)
+#define DIM_TIMERFD
+#include <poll.h>
+#include <sys/timerfd.h>
+#endif
+
 _DIM_PROTO( static void alrm_sig_handler,  (int num) );
 _DIM_PROTO( static void Std_timer_handler, () );
-_DIM_PROTO( static int stop_it,			   (int new_time) );
-_DIM_PROTO( static int start_it,		   (int new_time) );
-_DIM_PROTO( static int scan_it,			   () );
-_DIM_PROTO( static int get_minimum,		   (int deltat) );
+_DIM_PROTO( static int dtq_process,		   () );
+_DIM_PROTO( static void dtq_arm,		   (int wake, int tick) );
 _DIM_PROTO( int dtq_task, (void *dummy) );
-_DIM_PROTO( static int my_alarm, (int secs) );
 _DIM_PROTO( int dim_dtq_init,	   (int thr_flag) );
 #ifndef WIN32
 _DIM_PROTO( static void dummy_alrm_sig_handler, (int num) );
 #endif
 
-typedef struct {
-	TIMR_ENT *queue_head;
-	int remove_entries;
-} QUEUE_ENT;
-
+static int Queue_created[MAX_TIMER_QUEUES + 2] = { 0 };
 
-static QUEUE_ENT timer_queues[MAX_TIMER_QUEUES + 2] = { 
-	{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
-	{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}
-};
+static TIMR_ENT Wheel[WHEEL_SIZE];
+static TIMR_ENT Wheel_level_2[LEVEL_SIZE];
+static TIMR_ENT Wheel_level_3[LEVEL_SIZE];
+static TIMR_ENT Expired_head;		/* Due, being called */
+static TIMR_ENT Write_head;			/* WRITE_QUEUE */
+static TIMR_ENT *Free_entries = 0;
+static TIMR_ENT *Tag_buckets[DTQ_TAG_BUCKETS];
+static int Wheel_done = 0;
+static int Wheel_tick = 0;			/* Next tick to be processed */
+static int Wheel_entries = 0;
 
 static int Inside_ast = 0;
-static int Alarm_runs = 0;
 static int sigvec_done = 0;
 
-#ifdef VxWorks
-static timer_t Timer_id;
+static time_t Dtq_base_secs = 0;	/* Ticks are counted from here */
+static int Dtq_armed = 0;			/* The timer thread will wake up at... */
+static int Dtq_armed_tick = 0;
+static int Dtq_wake_pending = 0;	/* The timer thread was woken up */
+#ifndef WIN32
+static int Dtq_wake_pipe[2] = { -1, -1 };
+#endif
+#ifdef DIM_TIMERFD
+static int Dtq_timer_fd = -1;
 #endif
-
-static time_t DIM_last_time = 0;
-static int DIM_last_time_millies = 0;
-static int DIM_next_time = 0;
-static int DIM_time_left = 0;
 static int Threads_off = 0;
 
 /*
@@ -100,29 +129,23 @@ int ret = 0;
 	if( !sigvec_done) 
 	{
 	    Inside_ast = 0;
-	    Alarm_runs = 0;
-	    DIM_last_time = 0;
-/*
-	    for(i = 0; i < MAX_TIMER_QUEUES + 2; i++)
-	    {
-	        timer_queues[i].queue_head = 0;
-			timer_queues[i].remove_entries = 0;
-	    }
-*/
-		if( timer_queues[SPECIAL_QUEUE].queue_head == NULL ) {
-			timer_queues[SPECIAL_QUEUE].queue_head = (TIMR_ENT *)malloc(sizeof(TIMR_ENT));
-			memset(timer_queues[SPECIAL_QUEUE].queue_head, 0, sizeof(TIMR_ENT));
-			dll_init( (DLL *)timer_queues[SPECIAL_QUEUE].queue_head);
-		}
-		if( timer_queues[WRITE_QUEUE].queue_head == NULL ) {
-			timer_queues[WRITE_QUEUE].queue_head = (TIMR_ENT *)malloc(sizeof(TIMR_ENT));
-			memset(timer_queues[WRITE_QUEUE].queue_head, 0, sizeof(TIMR_ENT));
-			dll_init( (DLL *)timer_queues[WRITE_QUEUE].queue_head);
-		}
+		Queue_created[SPECIAL_QUEUE] = 1;
+		Queue_created[WRITE_QUEUE] = 1;
 	    if(!thr_flag)
 	    {
 	        Threads_off = 1;
 	    }
+		else
+		{
+			if(pipe(Dtq_wake_pipe) < 0)
+			{
+				perror( "pipe(DTQ)" );
+				exit(1);
+			}
+#ifdef DIM_TIMERFD
+			Dtq_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+		}
 		sigemptyset(&set);
 	  
 		sigaddset(&set,SIGIO);
@@ -162,25 +185,8 @@ int dim_dtq_init(int thr_flag)
 
 	if( !sigvec_done ) {
 		Inside_ast = 0;
-	    Alarm_runs = 0;
-	    DIM_last_time = 0;
-/*
-	    for(i = 0; i < MAX_TIMER_QUEUES + 2; i++)
-	    {
-	        timer_queues[i].queue_head = 0;
-			timer_queues[i].remove_entries = 0;
-	    }
-*/
-		if( timer_queues[SPECIAL_QUEUE].queue_head == NULL ) {
-			timer_queues[SPECIAL_QUEUE].queue_head = (TIMR_ENT *)malloc(sizeof(TIMR_ENT));
-			memset(timer_queues[SPECIAL_QUEUE].queue_head, 0, sizeof(TIMR_ENT));
-			dll_init( (DLL *)timer_queues[SPECIAL_QUEUE].queue_head);
-		}
-		if( timer_queues[WRITE_QUEUE].queue_head == NULL ) {
-			timer_queues[WRITE_QUEUE].queue_head = (TIMR_ENT *)malloc(sizeof(TIMR_ENT));
-			memset(timer_queues[WRITE_QUEUE].queue_head, 0, sizeof(TIMR_ENT));
-			dll_init( (DLL *)timer_queues[WRITE_QUEUE].queue_head);
-		}
+		Queue_created[SPECIAL_QUEUE] = 1;
+		Queue_created[WRITE_QUEUE] = 1;
 /*
 #ifndef STDCALL
 		tid = _beginthread((void *)(void *)dtq_task,0,NULL);
@@ -199,157 +205,430 @@ int dim_dtq_init(int thr_flag)
 
 void dim_dtq_stop()
 {
-/*
-	int i;
-	for(i = 0; i < MAX_TIMER_QUEUES + 2; i++)
+	dtq_process();
+	dtq_delete(WRITE_QUEUE);
+#ifndef WIN32
+	if(Dtq_wake_pipe[0] >= 0)
 	{
-		if( timer_queues[i].queue_head != NULL)
-		{
-			dtq_delete(i);
-			free((TIMR_ENT *)timer_queues[i].queue_head);
-			timer_queues[i].queue_head = 0;
-		}
+		close(Dtq_wake_pipe[0]);
+		close(Dtq_wake_pipe[1]);
+		Dtq_wake_pipe[0] = Dtq_wake_pipe[1] = -1;
 	}
-*/
-	scan_it();
-	if( timer_queues[WRITE_QUEUE].queue_head != NULL)
+#endif
+#ifdef DIM_TIMERFD
+	if(Dtq_timer_fd >= 0)
 	{
-		dtq_delete(WRITE_QUEUE);
-		free((TIMR_ENT *)timer_queues[WRITE_QUEUE].queue_head);
-		timer_queues[WRITE_QUEUE].queue_head = 0;
+		close(Dtq_timer_fd);
+		Dtq_timer_fd = -1;
 	}
+#endif
+	Dtq_armed = 0;
+	Dtq_wake_pending = 0;
 	sigvec_done = 0;
 }
 
-static int get_current_time(int *millies)
+static int get_current_tick()
 {
-	int secs;
+	time_t secs;
+	int millies;
 #ifdef WIN32
 	struct timeb timebuf;
+
+	ftime(&timebuf);
+	secs = timebuf.time;
+	millies = timebuf.millitm;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	secs = ts.tv_sec;
+	millies = (int)(ts.tv_nsec / 1000000);
 #else
 	struct timeval tv;
-	struct timezone *tz;
+
+	gettimeofday(&tv, 0);
+	secs = tv.tv_sec;
+	millies = (int)tv.tv_usec / 1000;
 #endif
+	if(!Dtq_base_secs)
+		Dtq_base_secs = secs - 1;
+	return (int)(secs - Dtq_base_secs) * DTQ_TICKS_PER_SEC + millies / DTQ_TICK_MS;
+}
 
-#ifdef WIN32
-	ftime(&timebuf);
-	secs = (int)timebuf.time;
-	*millies = timebuf.millitm;
+static int ticks_to_secs(int ticks)
+{
+	if(ticks <= 0)
+		return 0;
+	return (ticks + DTQ_TICKS_PER_SEC - 1) / DTQ_TICKS_PER_SEC;
+}
+
+void dim_usleep(int usecs)
+{
+
+#ifndef WIN32
+	struct timeval timeout;
+
+	timeout.tv_sec = 0;
+	timeout.tv_usec = usecs;
+	select(FD_SETSIZE, NULL, NULL, NULL, &timeout);
 #else
-	tz = 0;
-	gettimeofday(&tv, tz);
-	secs = (int)tv.tv_sec;
-	*millies = (int)tv.tv_usec / 1000;
+	usleep(usecs);
 #endif
-	return secs;
 }
 
-static int get_elapsed_time()
+/*
+ * Timer entries and the timing wheel, to be used with the DIM lock held
+ */
+
+static TIMR_ENT *get_entry()
+{
+	TIMR_ENT *entry;
+	int i;
+
+	if(!Free_entries)
+	{
+		entry = (TIMR_ENT *)malloc(DTQ_POOL_BLOCK * sizeof(TIMR_ENT));
+		for(i = 0; i < DTQ_POOL_BLOCK; i++, entry++)
+		{
+			entry->next = Free_entries;
+			Free_entries = entry;
+		}
+	}
+	entry = Free_entries;
+	Free_entries = entry->next;
+	memset(entry, 0, sizeof(TIMR_ENT));
+	return(entry);
+}
+
+static TIMR_ENT **tag_bucket(dim_long tag)
+{
+	return(&Tag_buckets[(unsigned long)tag % DTQ_TAG_BUCKETS]);
+}
+
+static void tag_insert(TIMR_ENT *entry)
+{
+	/* Entries of the SPECIAL_QUEUE are also kept by tag, in order, so
+	 * that dtq_stop_timer() finds them without looking through the wheel */
+	TIMR_ENT **headp, *lastp;
+
+	headp = tag_bucket(entry->tag);
+	entry->tag_next = 0;
+	if(!*headp)
+	{
+		entry->tag_prev = entry;
+		*headp = entry;
+	}
+	else
+	{
+		lastp = (*headp)->tag_prev;
+		lastp->tag_next = entry;
+		entry->tag_prev = lastp;
+		(*headp)->tag_prev = entry;
+	}
+}
+
+static void tag_remove(TIMR_ENT *entry)
+{
+	TIMR_ENT **headp;
+
+	headp = tag_bucket(entry->tag);
+	if(*headp == entry)
+	{
+		*headp = entry->tag_next;
+		if(*headp)
+			(*headp)->tag_prev = entry->tag_prev;
+	}
+	else
+	{
+		entry->tag_prev->tag_next = entry->tag_next;
+		if(entry->tag_next)
+			entry->tag_next->tag_prev = entry->tag_prev;
+		else
+			(*headp)->tag_prev = entry->tag_prev;
+	}
+}
+
+static void put_entry(TIMR_ENT *entry)
 {
-	int millies, deltat;
-	int now;
+	if(entry->queue_id == SPECIAL_QUEUE)
+		tag_remove(entry);
+	entry->queue_id = -1;
+	entry->next = Free_entries;
+	Free_entries = entry;
+}
+
+static void wheel_init()
+{
+	int i;
 
-	now = get_current_time(&millies);
-	deltat = now - (int)DIM_last_time;
-	if((millies + 50) < DIM_last_time_millies)
+	if(Wheel_done)
+		return;
+	for(i = 0; i < WHEEL_SIZE; i++)
+		dll_init((DLL *)&Wheel[i]);
+	for(i = 0; i < LEVEL_SIZE; i++)
 	{
-		deltat --;
+		dll_init((DLL *)&Wheel_level_2[i]);
+		dll_init((DLL *)&Wheel_level_3[i]);
 	}
-	return deltat;
+	dll_init((DLL *)&Expired_head);
+	dll_init((DLL *)&Write_head);
+	Wheel_tick = get_current_tick();
+	Wheel_done = 1;
 }
 
-static int my_alarm(int secs)
+static void wheel_insert(TIMR_ENT *entry)
 {
-	int ret;
+	int expires, delta;
+	TIMR_ENT *head;
+
+	expires = entry->expires;
+	delta = expires - Wheel_tick;
+	if(delta < 0)
+		head = &Wheel[Wheel_tick & WHEEL_MASK];
+	else if(delta < WHEEL_SIZE)
+		head = &Wheel[expires & WHEEL_MASK];
+	else if(delta < (1 << (WHEEL_BITS + LEVEL_BITS)))
+		head = &Wheel_level_2[(expires >> WHEEL_BITS) & LEVEL_MASK];
+	else
+	{
+		/* Too far away, it will be inserted again when cascaded */
+		if(delta >= WHEEL_MAX_TICKS)
+			expires = Wheel_tick + WHEEL_MAX_TICKS - 1;
+		head = &Wheel_level_3[(expires >> (WHEEL_BITS + LEVEL_BITS)) & LEVEL_MASK];
+	}
+	dll_insert_queue((DLL *)head, (DLL *)entry);
+}
 
-	DIM_next_time = secs;
+static void list_move(TIMR_ENT *from, TIMR_ENT *to)
+{
+	/* Move all the entries of from at the end of to */
+	if(dll_empty((DLL *)from))
+		return;
+	from->next->prev = to->prev;
+	to->prev->next = from->next;
+	from->prev->next = to;
+	to->prev = from->prev;
+	dll_init((DLL *)from);
+}
+
+static int wheel_cascade(TIMR_ENT *level, int index)
+{
+	TIMR_ENT list, *entry;
+
+	dll_init((DLL *)&list);
+	list_move(&level[index], &list);
+	while(!dll_empty((DLL *)&list))
+	{
+		entry = list.next;
+		dll_remove((DLL *)entry);
+		wheel_insert(entry);
+	}
+	return(index);
+}
+
+static void wheel_expire(int now)
+{
+	/* Move the entries due by now to Expired_head */
+	int index;
+
+	while(now - Wheel_tick >= 0)
+	{
+		index = Wheel_tick & WHEEL_MASK;
+		if(!index && 
+			!wheel_cascade(Wheel_level_2, (Wheel_tick >> WHEEL_BITS) & LEVEL_MASK))
+			wheel_cascade(Wheel_level_3, 
+				(Wheel_tick >> (WHEEL_BITS + LEVEL_BITS)) & LEVEL_MASK);
+		Wheel_tick++;
+		list_move(&Wheel[index], &Expired_head);
+	}
+}
+
+static int wheel_next_tick()
+{
+	/* The tick by which the wheel has to be looked at again */
+	int i, tick;
+
+	for(i = 0, tick = Wheel_tick; i < WHEEL_SIZE; i++, tick++)
+	{
+		if(!dll_empty((DLL *)&Wheel[tick & WHEEL_MASK]))
+			return(tick);
+		if(!((tick + 1) & WHEEL_MASK))
+			break;
+	}
+	return((Wheel_tick | WHEEL_MASK) + 1);
+}
+
+static void remove_entry(TIMR_ENT *entry)
+{
+	dll_remove((DLL *)entry);
+	if(entry->queue_id != WRITE_QUEUE)
+		Wheel_entries--;
+	put_entry(entry);
+}
+
+static void dtq_arm(int wake, int tick)
+{
+	/* Make sure the timer thread (or SIGALRM) is there when needed, tick
+	 * being the expiry of a new entry (or 0). Called with the DIM lock held */
+	int next, now, secs;
+#ifdef DIM_TIMERFD
+	struct itimerspec its;
+#endif
+
+	if(Inside_ast)
+		return;
+	if(!dll_empty((DLL *)&Write_head))
+		wake = 1;
 #ifndef WIN32
 	if(Threads_off)
 	{
-		if( secs < 0)
+		if(wake)
 		{
 			kill(getpid(),SIGALRM);
-			return(0);
+			return;
 		}
-		else
+		if(!Wheel_entries)
 		{
-			return((int)alarm((unsigned int)secs));
+			alarm(0);
+			Dtq_armed = 0;
+			return;
 		}
+		if(Dtq_armed && tick && (tick - Dtq_armed_tick >= 0))
+			return;
+		next = wheel_next_tick();
+		if(Dtq_armed && (next - Dtq_armed_tick >= 0))
+			return;
+		now = get_current_tick();
+		secs = ticks_to_secs(next - now);
+		if(!secs)
+			secs = 1;
+		alarm((unsigned int)secs);
+		Dtq_armed = 1;
+		Dtq_armed_tick = next;
+		return;
 	}
-	else
+#endif
+	if(wake)
 	{
+#ifndef WIN32
+		if(!Dtq_wake_pending && (Dtq_wake_pipe[1] >= 0))
+		{
+			Dtq_wake_pending = 1;
+			if(write(Dtq_wake_pipe[1], "w", 1)){}
+		}
+#endif
+		return;
+	}
+	if(!Wheel_entries)
+		return;
+	if(Dtq_armed && tick && (tick - Dtq_armed_tick >= 0))
+		return;
+	next = wheel_next_tick();
+	if(Dtq_armed && (next - Dtq_armed_tick >= 0))
+		return;
+	Dtq_armed = 1;
+	Dtq_armed_tick = next;
+#ifdef DIM_TIMERFD
+	if(Dtq_timer_fd >= 0)
+	{
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = Dtq_base_secs + next / DTQ_TICKS_PER_SEC;
+		its.it_value.tv_nsec = (long)(next % DTQ_TICKS_PER_SEC) * DTQ_TICK_MS * 1000000;
+		timerfd_settime(Dtq_timer_fd, TFD_TIMER_ABSTIME, &its, 0);
+		return;
+	}
 #endif
-
-		ret = DIM_time_left;
-
-		if(secs == 0)
-			DIM_next_time = -1;
-		return(ret);
 #ifndef WIN32
+	/* The timer thread computes its own timeout, only wake it up */
+	if(!Dtq_wake_pending && (Dtq_wake_pipe[1] >= 0))
+	{
+		Dtq_wake_pending = 1;
+		if(write(Dtq_wake_pipe[1], "w", 1)){}
 	}
 #endif
 }
 
-void dim_usleep(int usecs)
+#ifndef WIN32
+
+static void dtq_wait()
 {
+	/* Wait for the next timer or for something to do */
+	char buf[64];
+#ifdef DIM_TIMERFD
+	struct pollfd fds[2];
+	unsigned long long expirations;
+	int n;
 
-#ifndef WIN32
+	fds[0].fd = Dtq_wake_pipe[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = Dtq_timer_fd;
+	fds[1].events = POLLIN;
+	n = (Dtq_timer_fd >= 0) ? 2 : 1;
+	if(poll(fds, (nfds_t)n, (Dtq_timer_fd >= 0) ? -1 : DTQ_TICK_MS) > 0)
+	{
+		if((n == 2) && (fds[1].revents & POLLIN))
+		{
+			if(read(Dtq_timer_fd, &expirations, sizeof(expirations))){}
+		}
+		if(fds[0].revents & POLLIN)
+		{
+			if(read(Dtq_wake_pipe[0], buf, sizeof(buf))){}
+		}
+	}
+#else
+	fd_set rfds;
 	struct timeval timeout;
+	int ticks = DTQ_TICK_MS;
 
-	timeout.tv_sec = 0;
-	timeout.tv_usec = usecs;
-	select(FD_SETSIZE, NULL, NULL, NULL, &timeout);
-#else
-	usleep(usecs);
+	DISABLE_AST
+	if(Dtq_armed)
+		ticks = Dtq_armed_tick - get_current_tick();
+	else if(!Wheel_entries)
+		ticks = 60 * DTQ_TICKS_PER_SEC;
+	ENABLE_AST
+	if(ticks < 0)
+		ticks = 0;
+	timeout.tv_sec = ticks / DTQ_TICKS_PER_SEC;
+	timeout.tv_usec = (ticks % DTQ_TICKS_PER_SEC) * DTQ_TICK_MS * 1000;
+	FD_ZERO(&rfds);
+	FD_SET(Dtq_wake_pipe[0], &rfds);
+	if(select(Dtq_wake_pipe[0] + 1, &rfds, NULL, NULL, &timeout) > 0)
+	{
+		if(read(Dtq_wake_pipe[0], buf, sizeof(buf))){}
+	}
 #endif
+	DISABLE_AST
+	Dtq_wake_pending = 0;
+	Dtq_armed = 0;
+	ENABLE_AST
 }
 
 int dtq_task(void *dummy)
 {
-int deltat;
-static int to_go;
+	if(dummy){}
+	dtq_wait();
+	alrm_sig_handler(2);
+	return(1);
+}
+
+#else
 
+int dtq_task(void *dummy)
+{
 	if(dummy){}
 	while(1)
 	{
-		if(DIM_next_time)
-		{
-			DISABLE_AST
-			DIM_time_left = DIM_next_time;
-			if(DIM_time_left == -1)
-				DIM_time_left = 0;
-			to_go = DIM_next_time;
-			DIM_next_time = 0;
-			ENABLE_AST
-		}
-		if(DIM_time_left < 0)
-		{
-			DIM_time_left = 0;
-			alrm_sig_handler(2);
-#ifndef WIN32
-			return(1);
-#endif
-		}
-		else if(DIM_time_left > 0)
-		{
-			dim_usleep(100000);
-			deltat = get_elapsed_time();
-			DIM_time_left = to_go - deltat;
-			if(DIM_time_left <= 0)
-			{
-				alrm_sig_handler(2);
-#ifndef WIN32
-				return(1);
-#endif
-			}
-		}
-		else
-		{
-			dim_usleep(1000);
-		}
+		DISABLE_AST
+		Dtq_wake_pending = 0;
+		Dtq_armed = 0;
+		ENABLE_AST
+		alrm_sig_handler(2);
+		dim_usleep(1000);
 	}
 }
 
+#endif
+
 int dtq_create()
 {
 	int i;
@@ -360,128 +639,90 @@ int dtq_create()
 		dim_init_threads();
 	}
 	dim_dtq_init(0);
+	DISABLE_AST
 	for( i = 1; i < MAX_TIMER_QUEUES; i++ )
-		if( timer_queues[i].queue_head == 0 )
+		if( !Queue_created[i] )
 			break;
 
 	if( i == MAX_TIMER_QUEUES )
+	{
+		ENABLE_AST
 		return(0);
-
-	timer_queues[i].queue_head = (TIMR_ENT *)malloc( sizeof(TIMR_ENT) );
-	memset( timer_queues[i].queue_head, 0, sizeof(TIMR_ENT) );
-	dll_init( (DLL *)timer_queues[i].queue_head);
-
+	}
+	Queue_created[i] = 1;
+	ENABLE_AST
 	return(i);
 }
 
+static void delete_entries(TIMR_ENT *head, int queue_id)
+{
+	TIMR_ENT *entry, *nextp;
+
+	for(entry = head->next; entry != head; entry = nextp)
+	{
+		nextp = entry->next;
+		if(entry->queue_id == queue_id)
+			remove_entry(entry);
+	}
+}
 
 int dtq_delete(int queue_id)
 {
-	TIMR_ENT *queue_head, *entry;
+	int i;
 
 	DISABLE_AST
-	queue_head = timer_queues[queue_id].queue_head;
-	if(queue_head)
+	if(Wheel_done)
 	{
-		while(!dll_empty((DLL *)queue_head))
+		if(queue_id == WRITE_QUEUE)
+			delete_entries(&Write_head, queue_id);
+		else
 		{
-			entry = queue_head->next;
-			dll_remove(entry);
-			free(entry);
+			for(i = 0; i < WHEEL_SIZE; i++)
+				delete_entries(&Wheel[i], queue_id);
+			for(i = 0; i < LEVEL_SIZE; i++)
+			{
+				delete_entries(&Wheel_level_2[i], queue_id);
+				delete_entries(&Wheel_level_3[i], queue_id);
+			}
+			delete_entries(&Expired_head, queue_id);
 		}
-		free(queue_head);
-		timer_queues[queue_id].queue_head = 0;
 	}
+	Queue_created[queue_id] = 0;
 	ENABLE_AST
 	return(1);			
 }
 	
 TIMR_ENT *dtq_add_entry(int queue_id, int time, void (*user_routine)(), dim_long tag)
 {
-	TIMR_ENT *new_entry, *queue_head, *auxp, *prevp;
-	int next_time, min_time = 100000;
-	int time_left, deltat = 0;
+	TIMR_ENT *new_entry;
+	int ticks;
 
 	DISABLE_AST 
-
-	next_time = time;
-	if(!next_time)
-		next_time = -10;
-	if(Alarm_runs)
-	{
-		time_left = DIM_time_left;
-		if(!time_left)
-			time_left = DIM_next_time;
-		if((time_left > next_time) || (queue_id == SPECIAL_QUEUE))
-	    {
-			if(next_time != -10)
-			{
-				min_time = stop_it();
-				if((next_time > min_time) && (min_time != 0))
-					next_time = min_time;
-			}
-			else
-				my_alarm(next_time);
-	    }
-		else
-		{
-		    deltat = get_elapsed_time();
-		}
-	}
-	new_entry = (TIMR_ENT *)malloc( sizeof(TIMR_ENT) );
+	wheel_init();
+	new_entry = get_entry();
 	new_entry->time = time;
     if( user_routine )
    	   	new_entry->user_routine = user_routine;
 	else
        	new_entry->user_routine = Std_timer_handler;
 	new_entry->tag = tag;
-	new_entry->time_left = time + deltat;
-
-	queue_head = timer_queues[queue_id].queue_head;
-	if(!time)
+	new_entry->queue_id = queue_id;
+	if(queue_id == WRITE_QUEUE)
 	{
-		dll_insert_after((DLL *)queue_head->prev, (DLL *)new_entry);
+		dll_insert_queue((DLL *)&Write_head, (DLL *)new_entry);
+		dtq_arm(1, 0);
 	}
 	else
 	{
-		if(queue_head)
-		{
-			auxp = queue_head;
-			prevp = auxp;
-			while((auxp = (TIMR_ENT *)dll_get_prev((DLL *)queue_head, (DLL *)auxp)))
-			{
-				if(time >= auxp->time)
-				{
-					break;
-				}
-				prevp = auxp;
-			}
-/*
-			if(auxp)
-			{
-				if(queue_id != SPECIAL_QUEUE)
-				{
-					if(auxp->time_left > 0)
-					{
-						if(auxp->time == time)
-							new_entry->time_left = auxp->time_left;
-					}
-				}
-				prevp = auxp;
-			}
-*/
-			dll_insert_after((DLL *)prevp, (DLL *)new_entry);
-		}
-	}
-	if(!Alarm_runs)
-	{
-		if((next_time != -10) && (min_time == 100000))
-		{
-			min_time = get_minimum(0);
-			if(next_time > min_time)
-				next_time = min_time;
-		}
-		start_it(next_time);
+		ticks = time * DTQ_TICKS_PER_SEC;
+		if(ticks <= 0)
+			ticks = 1;
+		new_entry->expires = get_current_tick() + ticks;
+		wheel_insert(new_entry);
+		Wheel_entries++;
+		if(queue_id == SPECIAL_QUEUE)
+			tag_insert(new_entry);
+		dtq_arm(0, new_entry->expires);
 	}
 	ENABLE_AST
 	return(new_entry); 
@@ -489,12 +730,17 @@ TIMR_ENT *dtq_add_entry(int queue_id, int time, void (*user_routine)(), dim_long
 
 int dtq_clear_entry(TIMR_ENT *entry)
 {
-	int time_left, deltat = 0;
+	int time_left, now, ticks;
 
 	DISABLE_AST
-	deltat = get_elapsed_time();
-	time_left = entry->time_left - deltat;
-	entry->time_left = entry->time + deltat;
+	now = get_current_tick();
+	time_left = ticks_to_secs(entry->expires - now);
+	ticks = entry->time * DTQ_TICKS_PER_SEC;
+	if(ticks <= 0)
+		ticks = 1;
+	entry->expires = now + ticks;
+	dll_remove((DLL *)entry);
+	wheel_insert(entry);
 	ENABLE_AST
 	return(time_left);
 }
@@ -502,284 +748,96 @@ int dtq_clear_entry(TIMR_ENT *entry)
 
 int dtq_rem_entry(int queue_id, TIMR_ENT *entry)
 {
-	int time_left, deltat = 0;
+	int time_left;
 
+	if(queue_id){}
 	DISABLE_AST
-	deltat = get_elapsed_time();
-	time_left = entry->time_left - deltat;
-	if( Inside_ast ) 
-	{
-		timer_queues[queue_id].remove_entries++;
-		entry->time = -1;
-		ENABLE_AST
-		return(time_left);
-	}
-	dll_remove(entry);
-	free(entry);
-
+	time_left = ticks_to_secs(entry->expires - get_current_tick());
+	remove_entry(entry);
 	ENABLE_AST
 	return(time_left);
 }
 
-static int rem_deleted_entries(int queue_id)
+static int dtq_process()
 {
-	TIMR_ENT *auxp, *prevp, *queue_head;
-	int n;
+	/* Call the WRITE_QUEUE routines (without the DIM lock) and the timers
+	 * that are due. Returns 1 if there is more to do. */
+	int i, n = 0, ticks;
+	TIMR_ENT *entry, *done[MAX_WRITE_BATCH];
+	void (*user_routine)();
+	dim_long tag;
 
 	DISABLE_AST
-	queue_head = timer_queues[queue_id].queue_head;
-	n = timer_queues[queue_id].remove_entries;
-	if(queue_head)
-	{
-		auxp = queue_head;
-		prevp = auxp;
-		while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head, (DLL *)auxp)) )
-		{
-			if(auxp->time == -1)
-			{
-				dll_remove(auxp);
-				free(auxp);
-				auxp = prevp;
-				n--;
-				if(!n)
-					break;
-			}
-			else
-				prevp = auxp;
-		}
-	}
-	ENABLE_AST;
-	return(1);
-}
-
-static int get_minimum(int deltat)
-{
-	TIMR_ENT *auxp, *queue_head;
-	int queue_id;
-	int min_time = 100000;
-
-	queue_head = timer_queues[WRITE_QUEUE].queue_head;
-	if( dll_get_next((DLL *)queue_head,(DLL *)queue_head))
-		min_time = -10;
-	if((min_time != -10) || deltat)
-	{
-		if( (queue_head = timer_queues[SPECIAL_QUEUE].queue_head) != NULL)
-		{
-			auxp = queue_head;
-			while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)auxp)) )
-			{
-				auxp->time_left -= deltat;
-				if(auxp->time_left > 0)
-				{
-					if(auxp->time_left < min_time)
-					{
-						min_time = auxp->time_left;
-					}
-				}
-			}
-		}
-		for( queue_id = 0; queue_id < MAX_TIMER_QUEUES; queue_id++ ) 
-		{
-			if( (queue_head = timer_queues[queue_id].queue_head) == NULL )
-				continue;
-			auxp = queue_head;
-			while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)auxp)) )
-			{
-				auxp->time_left -= deltat;
-				if(auxp->time_left > 0)
-				{
-					if(auxp->time_left < min_time)
-					{
-						min_time = auxp->time_left;
-					}
-				}
-				else
-				{
-					if(auxp->time < min_time)
-					{
-						min_time = auxp->time;
-					}
-				}
-				if((!deltat) && (min_time <= 1))
-					break;
-			}
-		}
-	}
-	if(min_time == 100000)
-		min_time = 0;
-	return min_time;
-}
-
-static int stop_it()
-{
-	int min_time;
-    int deltat = 0;
-
-	DISABLE_AST
-	if(Alarm_runs)
-	{
-		my_alarm(0);
-        deltat = get_elapsed_time();
-		if(deltat != 0)
-			DIM_last_time = get_current_time(&DIM_last_time_millies);
-		Alarm_runs = 0;
-	}
-	min_time = get_minimum(deltat);
-	ENABLE_AST
-	return(min_time);
-}
-
-static int start_it(int new_time)
-{
-	int next_time;
-	TIMR_ENT *queue_head;
-
-	DISABLE_AST
-	next_time = new_time;
-	if(next_time > 0)
-	{
-		queue_head = timer_queues[WRITE_QUEUE].queue_head;
-		if( dll_get_next((DLL *)queue_head,(DLL *)queue_head))
-		{
-			next_time = -10;
-		}
-	}
-	if(next_time)
-	{
-		my_alarm(next_time);
-		Alarm_runs = 1;
-		if(!DIM_last_time)
-			DIM_last_time = get_current_time(&DIM_last_time_millies);
-	}
-	else
-		DIM_last_time = 0;
-
-	ENABLE_AST
-	return(1);
-}
-
-static int scan_it()
-{
-	int queue_id, i, n = 0;
-	static int curr_queue_id = 0;
-	static TIMR_ENT *curr_entry = 0;
-	TIMR_ENT *auxp, *prevp, *queue_head;
-	TIMR_ENT *done[1024];
-
-	DISABLE_AST
-	queue_head = timer_queues[WRITE_QUEUE].queue_head;
-	if(!queue_head)
+	if(!Wheel_done || Inside_ast)
 	{
 		ENABLE_AST
 		return(0);
 	}
-	auxp = queue_head;
-	while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)auxp)) )
-	{	
-		done[n++] = auxp;
-		if(n == 1000)
-			break;
+	while(!dll_empty((DLL *)&Write_head) && (n < MAX_WRITE_BATCH))
+	{
+		entry = Write_head.next;
+		dll_remove((DLL *)entry);
+		done[n++] = entry;
 	}
 	ENABLE_AST
 	for(i = 0; i < n; i++)
 	{
-		auxp = done[i];
-		auxp->user_routine( auxp->tag );
-	}
-	{
-		DISABLE_AST
-		for(i = 0; i < n; i++)
-		{
-			auxp = done[i];
-			dll_remove(auxp);
-			free(auxp);
-		}
-		if(n == 1000)
-		{
-			ENABLE_AST
-			return(1);
-		}
-		ENABLE_AST
+		entry = done[i];
+		entry->user_routine( entry->tag );
 	}
 	{
 	DISABLE_AST
-	queue_head = timer_queues[SPECIAL_QUEUE].queue_head;
-	auxp = queue_head;
-	prevp = auxp;
-	while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)auxp)) )
-	{	
-		if(auxp->time_left <= 0)
+	for(i = 0; i < n; i++)
+		put_entry(done[i]);
+	Inside_ast = 1;
+	wheel_expire(get_current_tick());
+	while(!dll_empty((DLL *)&Expired_head))
+	{
+		entry = Expired_head.next;
+		dll_remove((DLL *)entry);
+		if(entry->queue_id == SPECIAL_QUEUE)
 		{
-			dll_remove(auxp);
-			auxp->user_routine( auxp->tag );
-			free(auxp);
-			auxp = prevp;
-			n++;
-			if(n == 100)
-			{
-				ENABLE_AST
-				return(1);
-			}
+			user_routine = entry->user_routine;
+			tag = entry->tag;
+			Wheel_entries--;
+			put_entry(entry);
+			user_routine( tag );
 		}
 		else
-			prevp = auxp;
-	}
-	for( queue_id = curr_queue_id; queue_id < MAX_TIMER_QUEUES; queue_id++ ) 
-	{
-		if( (queue_head = timer_queues[queue_id].queue_head) == NULL )
-			continue;
-		Inside_ast = 1;
-		if((curr_entry) && (queue_id == curr_queue_id))
-			auxp = curr_entry;
-		else
-			auxp = queue_head;
-		while( (auxp = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)auxp)) )
-		{	
-			if(auxp->time_left <= 0)
-			{
-				auxp->user_routine( auxp->tag );
-				auxp->time_left = auxp->time; /*restart clock*/
-				n++;
-				if(n == 100)
-				{
-					curr_queue_id = queue_id;
-					curr_entry = auxp;
-					ENABLE_AST
-					return(1);
-				}
-			}
-		}
-		Inside_ast = 0;
-		if( timer_queues[queue_id].remove_entries ) {
-			rem_deleted_entries( queue_id );
-			timer_queues[queue_id].remove_entries = 0;
+		{
+			/* restart clock, before calling the routine (which may remove
+			 * the entry) */
+			ticks = entry->time * DTQ_TICKS_PER_SEC;
+			if(ticks <= 0)
+				ticks = 1;
+			entry->expires = Wheel_tick - 1 + ticks;
+			wheel_insert(entry);
+			entry->user_routine( entry->tag );
 		}
 	}
-	curr_queue_id = 0;
-	curr_entry = 0;
+	Inside_ast = 0;
+	n = !dll_empty((DLL *)&Write_head);
 	ENABLE_AST
 	}
-	return(0);
+	return(n);
 }
 
 static void alrm_sig_handler( int num)
 {
-	int next_time;
-
 	if(num){}
-	next_time = stop_it();
 	if(Threads_off)
 	{
-		if(scan_it())
-			next_time = -10;
+		dtq_process();
 	}
 	else
 	{
-		while(scan_it());
+		while(dtq_process());
 	}
-	if(!Alarm_runs)
 	{
-		start_it(next_time);
+	DISABLE_AST
+	Dtq_armed = 0;
+	dtq_arm(0, 0);
+	ENABLE_AST
 	}
 }
 
@@ -802,22 +860,22 @@ void dtq_start_timer(int time, void (*user_routine)(), dim_long tag)
 		dtq_add_entry(WRITE_QUEUE, time, user_routine, tag);
 }
 
-
 int dtq_stop_timer(dim_long tag)
 {
-	TIMR_ENT *entry, *queue_head;
+	/* Stop the oldest timer started with tag, returns -1 if none */
+	TIMR_ENT *entry;
 	int time_left = -1;
 
-	queue_head = timer_queues[SPECIAL_QUEUE].queue_head;
-	entry = queue_head;
-	while( (entry = (TIMR_ENT *)dll_get_next((DLL *)queue_head,(DLL *)entry)) )
+	DISABLE_AST
+	for(entry = *tag_bucket(tag); entry; entry = entry->tag_next)
 	{
-		if( entry->tag == tag ) 
+		if(entry->tag == tag)
 		{
 			time_left = dtq_rem_entry( SPECIAL_QUEUE, entry );
 			break;
 		}
 	}
+	ENABLE_AST
 	return(time_left);
 }
 
@@ -19,21 +19,321 @@ int	max;
 	return (code % max);
 }
 */
-int HashFunction(char *name, int max)
+unsigned int HashName(char *name)
 {
    unsigned int b    = 378551;
    unsigned int a    = 63689;
    unsigned int hash = 0;
-   int i    = 0;
-   int len;
-
-   len = (int)strlen(name);
 
-   for(i = 0; i < len; name++, i++)
+   for(; *name; name++)
    {
       hash = hash*a+(unsigned)(*name);
       a = a*b;
    }
 
-   return ((int)(hash % (unsigned)max));
+   return (hash);
+}
+
+int HashFunction(char *name, int max)
+{
+   return ((int)(HashName(name) % (unsigned)max));
+}
+
+/*
+ * Open addressing hash table of named items (services), with linear
+ * probing. Removed items leave a tombstone, so items never move while
+ * the table is being walked with hash_table_get_next(): the table is
+ * never resized during a walk. Items inserted into a table too full to
+ * take them during a walk are kept in the pending list, which is walked
+ * after the slots and moved into the table once the walks are over.
+ * Slots are grouped in blocks counting the items inserted and not yet
+ * "unmarked", so that a walk can skip the blocks without new items.
+ */
+
+#define HASH_DELETED		((void *)&Hash_deleted)
+#define HASH_INIT_SIZE		1024
+#define HASH_BLOCK_SHIFT	6
+
+static int Hash_deleted;
+
+static unsigned int hash_slot(unsigned int hash, int size)
+{
+	/* The name hash is weak in its low bits, mix it first */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return (hash & (unsigned)(size - 1));
+}
+
+static char *hash_item_name(HASH_TABLE *table, void *item)
+{
+	return ((char *)item + table->name_offset);
+}
+
+void hash_table_init(HASH_TABLE *table, int name_offset)
+{
+	memset(table, 0, sizeof(HASH_TABLE));
+	table->name_offset = name_offset;
+}
+
+static void hash_table_place(HASH_TABLE *table, HASH_SLOT *slotp)
+{
+	unsigned int index;
+
+	index = hash_slot(slotp->hash, table->size);
+	while(table->slots[index].item)
+		index = (index + 1) & (unsigned)(table->size - 1);
+	table->slots[index] = *slotp;
+	if(slotp->marked)
+		table->marks[index >> HASH_BLOCK_SHIFT]++;
+}
+
+static void hash_table_resize(HASH_TABLE *table, int size)
+{
+	/* Never called during a walk, also moves the pending items in */
+	HASH_SLOT *old_slots, *slotp;
+	int i, old_size;
+
+	old_slots = table->slots;
+	old_size = table->size;
+	table->slots = (HASH_SLOT *) calloc((size_t)size, sizeof(HASH_SLOT));
+	table->marks = (int *) realloc(table->marks,
+		(size_t)((size >> HASH_BLOCK_SHIFT) + 1) * sizeof(int));
+	memset(table->marks, 0, (size_t)((size >> HASH_BLOCK_SHIFT) + 1) * sizeof(int));
+	table->size = size;
+	table->n_deleted = 0;
+	for(i = 0, slotp = old_slots; i < old_size; i++, slotp++)
+	{
+		if(slotp->item && (slotp->item != HASH_DELETED))
+			hash_table_place(table, slotp);
+	}
+	for(i = 0, slotp = table->pending; i < table->n_pending; i++, slotp++)
+	{
+		if(slotp->item != HASH_DELETED)
+			hash_table_place(table, slotp);
+	}
+	table->n_pending = 0;
+	if(old_slots)
+		free(old_slots);
+}
+
+static void hash_table_grow(HASH_TABLE *table)
+{
+	/* Grow, or only clean up the tombstones */
+	int size;
+
+	size = table->size;
+	while(table->n_items * 2 > size)
+		size *= 2;
+	hash_table_resize(table, size);
+}
+
+int hash_table_insert(HASH_TABLE *table, void *item)
+{
+	unsigned int hash, index;
+	HASH_SLOT *slotp;
+
+	if(!table->size)
+	{
+		hash_table_resize(table, HASH_INIT_SIZE);
+	}
+	else if((table->n_items + table->n_deleted + 1) * 4 > table->size * 3)
+	{
+		if(table->walking)
+		{
+			if(table->n_pending == table->pending_size)
+			{
+				table->pending_size = table->pending_size ?
+					table->pending_size * 2 : HASH_INIT_SIZE;
+				table->pending = (HASH_SLOT *) realloc(table->pending,
+					(size_t)table->pending_size * sizeof(HASH_SLOT));
+			}
+			slotp = &table->pending[table->n_pending++];
+			slotp->hash = HashName(hash_item_name(table, item));
+			slotp->item = item;
+			slotp->marked = 1;
+			table->n_items++;
+			return (table->size + table->n_pending - 1);
+		}
+		hash_table_grow(table);
+	}
+	else if(table->n_pending && !table->walking)
+	{
+		hash_table_grow(table);
+	}
+	hash = HashName(hash_item_name(table, item));
+	index = hash_slot(hash, table->size);
+	while(1)
+	{
+		slotp = &table->slots[index];
+		if(!slotp->item)
+			break;
+		if(slotp->item == HASH_DELETED)
+		{
+			table->n_deleted--;
+			break;
+		}
+		index = (index + 1) & (unsigned)(table->size - 1);
+	}
+	slotp->hash = hash;
+	slotp->item = item;
+	slotp->marked = 1;
+	table->marks[index >> HASH_BLOCK_SHIFT]++;
+	table->n_items++;
+	return ((int)index);
+}
+
+static int hash_table_search(HASH_TABLE *table, char *name, void *item)
+{
+	/* Returns the index of the item (pending ones after the slots) or -1 */
+	unsigned int hash, index;
+	HASH_SLOT *slotp;
+	int i;
+
+	if(!table->n_items)
+		return (-1);
+	hash = HashName(name);
+	index = hash_slot(hash, table->size);
+	while( (slotp = &table->slots[index])->item )
+	{
+		if((slotp->hash == hash) && (slotp->item != HASH_DELETED))
+		{
+			if(item)
+			{
+				if(slotp->item == item)
+					return ((int)index);
+			}
+			else if(!strcmp(hash_item_name(table, slotp->item), name))
+				return ((int)index);
+		}
+		index = (index + 1) & (unsigned)(table->size - 1);
+	}
+	for(i = 0, slotp = table->pending; i < table->n_pending; i++, slotp++)
+	{
+		if((slotp->hash == hash) && (slotp->item != HASH_DELETED))
+		{
+			if(item)
+			{
+				if(slotp->item == item)
+					return (table->size + i);
+			}
+			else if(!strcmp(hash_item_name(table, slotp->item), name))
+				return (table->size + i);
+		}
+	}
+	return (-1);
+}
+
+static HASH_SLOT *hash_table_slot(HASH_TABLE *table, int index)
+{
+	if((index < 0) || (index >= table->size + table->n_pending))
+		return ((HASH_SLOT *)0);
+	if(index >= table->size)
+		return (&table->pending[index - table->size]);
+	return (&table->slots[index]);
+}
+
+void *hash_table_find(HASH_TABLE *table, char *name)
+{
+	int index;
+
+	if( (index = hash_table_search(table, name, (void *)0)) != -1 )
+		return (hash_table_slot(table, index)->item);
+	return ((void *)0);
+}
+
+int hash_table_remove(HASH_TABLE *table, void *item)
+{
+	HASH_SLOT *slotp;
+	int index;
+
+	if( (index = hash_table_search(table, hash_item_name(table, item), item)) == -1 )
+		return (0);
+	hash_table_unmark(table, index);
+	slotp = hash_table_slot(table, index);
+	slotp->item = HASH_DELETED;
+	table->n_items--;
+	if(index < table->size)
+		table->n_deleted++;
+	return (1);
+}
+
+void hash_table_unmark(HASH_TABLE *table, int index)
+{
+	HASH_SLOT *slotp;
+
+	if( !(slotp = hash_table_slot(table, index)) )
+		return;
+	if(slotp->marked)
+	{
+		slotp->marked = 0;
+		if(index < table->size)
+			table->marks[index >> HASH_BLOCK_SHIFT]--;
+	}
+}
+
+void hash_table_walk_end(HASH_TABLE *table, int *curr_index)
+{
+	/* End the walk at *curr_index (if not over yet), to be called when
+	 * a walk is abandoned before hash_table_get_next() returned 0 */
+	if(*curr_index == -1)
+		return;
+	*curr_index = -1;
+	if(table->walking > 0)
+		table->walking--;
+	if(!table->walking && table->n_pending)
+		hash_table_grow(table);
+}
+
+void *hash_table_get_next(HASH_TABLE *table, int *curr_index, void *prevp,
+	int marked)
+{
+	/* Walk the table: start with *curr_index = -1, the walk is over when
+	 * 0 is returned. With prevp = 0 the walk resumes at *curr_index, so
+	 * the current item can be removed in between. With marked, the
+	 * blocks without marked items are skipped. A walk stopped before
+	 * its end has to be ended with hash_table_walk_end(), the table is
+	 * not resized until then. */
+	int index;
+	HASH_SLOT *slotp;
+
+	index = *curr_index;
+	if(index == -1)
+	{
+		index = 0;
+		table->walking++;
+	}
+	else if(prevp)
+	{
+		index++;
+	}
+	for(; index < table->size; index++)
+	{
+		if(marked && !(index & ((1 << HASH_BLOCK_SHIFT) - 1)) &&
+			!table->marks[index >> HASH_BLOCK_SHIFT])
+		{
+			index += (1 << HASH_BLOCK_SHIFT) - 1;
+			continue;
+		}
+		slotp = &table->slots[index];
+		if(slotp->item && (slotp->item != HASH_DELETED))
+		{
+			*curr_index = index;
+			return (slotp->item);
+		}
+	}
+	for(; index < table->size + table->n_pending; index++)
+	{
+		slotp = &table->pending[index - table->size];
+		if((slotp->item != HASH_DELETED) && (!marked || slotp->marked))
+		{
+			*curr_index = index;
+			return (slotp->item);
+		}
+	}
+	*curr_index = index;
+	hash_table_walk_end(table, curr_index);
+	return ((void *)0);
 }
@@ -65,6 +65,7 @@ typedef int pid_t;
 
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -75,8 +76,17 @@ typedef int pid_t;
 
 #endif
 
+#define TCPIP_MAX_IOV		64		/* Pieces written per system call */
+
+#if defined(__linux__) && !defined(DIM_NO_EPOLL)
+#define DIM_EPOLL
+#endif
+
 #ifdef __linux__
 #include <poll.h>
+#ifdef DIM_EPOLL
+#include <sys/epoll.h>
+#endif
 #define MY_FD_ZERO(set)	
 #define MY_FD_SET(fd, set)		poll_add(fd)
 #define MY_FD_CLR(fd, set)
@@ -99,10 +109,38 @@ static int	queue_id = 0;
 static struct sockaddr_in DIM_sockname;
 #endif
 
-static int DIM_IO_path[2] = {-1,-1};
-static int DIM_IO_Done = 0;
 static int DIM_IO_valid = 1;
 
+/* One per IO thread: its wake-up path and, with epoll, its own set of
+ * channels. A connection is given to the least loaded IO thread when it
+ * starts reading or listening (enable_sig) and stays with it until
+ * tcpip_close(). Without epoll there is a single IO thread.
+ */
+typedef struct {
+	int io_path[2];
+	int io_done;
+	int n_conns;
+#ifdef DIM_EPOLL
+	int epoll_fd;
+	int epoll_pipe;
+	struct epoll_event *events;
+	int n_events;
+	int curr_event;
+	unsigned int curr_mask;
+	int pipe_ready;
+#endif
+} IO_REACTOR;
+
+static IO_REACTOR Io_reactors[MAX_IO_THREADS];
+static int N_io_reactors = 1;
+static int Io_threads = 1;
+static int Io_threads_set = 0;
+#ifdef DIM_EPOLL
+static __thread IO_REACTOR *Curr_reactor = 0;
+#else
+static IO_REACTOR *Curr_reactor = &Io_reactors[0];
+#endif
+
 static int Listen_backlog = SOMAXCONN;
 static int Keepalive_timeout_set = 0;
 static int Write_timeout = WRITE_TMOUT;
@@ -192,6 +230,79 @@ int dim_get_read_buffer_size()
 	return(Read_buffer_size);
 }
 
+int dim_set_io_threads(int n)
+{
+#ifdef DIM_EPOLL
+	if((n >= 1) && (n <= MAX_IO_THREADS))
+#else
+	if(n == 1)
+#endif
+	{
+		Io_threads = n;
+		Io_threads_set = 1;
+		return(1);
+	}
+	return(0);
+}
+
+int dim_get_io_threads()
+{
+	int ret;
+	extern int get_io_threads();
+
+	if(!Io_threads_set)
+	{
+		ret = get_io_threads();
+#ifdef DIM_EPOLL
+		if((ret >= 1) && (ret <= MAX_IO_THREADS))
+			Io_threads = ret;
+#endif
+	}
+	return(Io_threads);
+}
+
+static void io_reactors_init(int n)
+{
+	int i;
+
+	for(i = 0; i < MAX_IO_THREADS; i++)
+	{
+		Io_reactors[i].io_path[0] = -1;
+		Io_reactors[i].io_path[1] = -1;
+		Io_reactors[i].io_done = 0;
+		Io_reactors[i].n_conns = 0;
+#ifdef DIM_EPOLL
+		Io_reactors[i].epoll_fd = -1;
+		Io_reactors[i].epoll_pipe = -1;
+		Io_reactors[i].n_events = 0;
+		Io_reactors[i].curr_event = 0;
+		Io_reactors[i].curr_mask = 0;
+		Io_reactors[i].pipe_ready = 0;
+#endif
+	}
+	N_io_reactors = n;
+}
+
+/* Pick the IO thread for a connection (if not done yet) */
+
+static IO_REACTOR *io_reactor_assign(int conn_id)
+{
+	int i, best;
+
+	if(!Net_conns[conn_id].io_thread)
+	{
+		best = 0;
+		for(i = 1; i < N_io_reactors; i++)
+		{
+			if(Io_reactors[i].n_conns < Io_reactors[best].n_conns)
+				best = i;
+		}
+		Io_reactors[best].n_conns++;
+		Net_conns[conn_id].io_thread = best + 1;
+	}
+	return(&Io_reactors[Net_conns[conn_id].io_thread - 1]);
+}
+
 #ifdef WIN32
 int init_sock()
 {
@@ -246,6 +357,7 @@ int dim_tcpip_init(int thr_flag)
 #else
 	struct sigaction sig_info;
 	sigset_t set;
+	int i;
 	void io_sig_handler();
 	void dummy_io_sig_handler();
 	void tcpip_pipe_sig_handler();
@@ -256,6 +368,7 @@ int dim_tcpip_init(int thr_flag)
 		return(1);
 
 	dim_get_write_timeout();
+	io_reactors_init(thr_flag ? dim_get_io_threads() : 1);
 #ifdef WIN32
 	init_sock();
 	Threads_on = 1;
@@ -302,9 +415,9 @@ int dim_tcpip_init(int thr_flag)
 	if(Threads_on)
 	{
 #ifdef WIN32
-		if(DIM_IO_path[0] == -1)
+		if(Io_reactors[0].io_path[0] == -1)
 		{
-			if( (DIM_IO_path[0] = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1 ) 
+			if( (Io_reactors[0].io_path[0] = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1 ) 
 			{
 				perror("socket");
 				return(0);
@@ -314,13 +427,16 @@ int dim_tcpip_init(int thr_flag)
 			addr = 0;
 			DIM_sockname.sin_addr = *((struct in_addr *) &addr);
 			DIM_sockname.sin_port = htons((ushort) 2000); 
-			ioctl(DIM_IO_path[0], FIONBIO, &flags);
+			ioctl(Io_reactors[0].io_path[0], FIONBIO, &flags);
 		}
 #else
-		if(DIM_IO_path[0] == -1)
+		for(i = 0; i < N_io_reactors; i++)
 		{
+			if(Io_reactors[i].io_path[0] == -1)
+			{
       int retval __attribute__((unused));
-			retval = pipe(DIM_IO_path);
+				retval = pipe(Io_reactors[i].io_path);
+			}
 		}
 #endif
 	}
@@ -342,23 +458,43 @@ int dim_tcpip_init(int thr_flag)
 	return(1);
 }
 
+#ifdef DIM_EPOLL
+static int poll_add_conn(int conn_id);
+static void poll_rem_channel(IO_REACTOR *reactor, int channel);
+static void poll_destroy(IO_REACTOR *reactor);
+#endif
+
 void dim_tcpip_stop()
 {
+	int i;
+	IO_REACTOR *reactor;
+
+	for(i = 0; i < N_io_reactors; i++)
+	{
+		reactor = &Io_reactors[i];
 #ifdef WIN32
-	closesock(DIM_IO_path[0]);
+		closesock(reactor->io_path[0]);
 #else
-	close(DIM_IO_path[0]);
-	close(DIM_IO_path[1]);
+		if(reactor->io_path[0] != -1)
+		{
+			close(reactor->io_path[0]);
+			close(reactor->io_path[1]);
+		}
+#endif
+		reactor->io_path[0] = -1;
+		reactor->io_path[1] = -1;
+		reactor->io_done = 0;
+#ifdef DIM_EPOLL
+		poll_destroy(reactor);
 #endif
-	DIM_IO_path[0] = -1;
-	DIM_IO_path[1] = -1;
-	DIM_IO_Done = 0;
+	}
 	init_done = 0;
 }
 
 static int enable_sig(int conn_id)
 {
 	int ret = 1, flags = 1;
+	IO_REACTOR *reactor;
 #ifndef WIN32
 	int pid;
 #endif
@@ -375,34 +511,35 @@ static int enable_sig(int conn_id)
 	{
 		dim_tcpip_init(0);
 	}
+	reactor = io_reactor_assign(conn_id);
 	if(Threads_on)
 	{
 #ifdef WIN32
 		DIM_IO_valid = 0;
 /*
-		ret = connect(DIM_IO_path[0], (struct sockaddr*)&DIM_sockname, sizeof(DIM_sockname));
+		ret = connect(reactor->io_path[0], (struct sockaddr*)&DIM_sockname, sizeof(DIM_sockname));
 */
-		closesock(DIM_IO_path[0]);
-		DIM_IO_path[0] = -1;
-		if( (DIM_IO_path[0] = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1 ) 
+		closesock(reactor->io_path[0]);
+		reactor->io_path[0] = -1;
+		if( (reactor->io_path[0] = (int)socket(AF_INET, SOCK_STREAM, 0)) == -1 ) 
 		{
 			perror("socket");
 			return(1);
 		}		
-		ret = ioctl(DIM_IO_path[0], FIONBIO, &flags);
+		ret = ioctl(reactor->io_path[0], FIONBIO, &flags);
 		if(ret != 0)
 		{
 			perror("ioctlsocket");
 		}
 		DIM_IO_valid = 1;
 #else
-		if(DIM_IO_path[1] != -1)
+		if(reactor->io_path[1] != -1)
 		{
-			if(!DIM_IO_Done)
+			if(!reactor->io_done)
 			{
-				DIM_IO_Done = 1;
+				reactor->io_done = 1;
         int retval __attribute__((unused));
-				retval = write(DIM_IO_path[1], &flags, 4);
+				retval = write(reactor->io_path[1], &flags, 4);
 			}
 		}
 #endif
@@ -449,6 +586,10 @@ static int enable_sig(int conn_id)
 #endif
 		return(ret);
     }
+#endif
+#ifdef DIM_EPOLL
+	if(!poll_add_conn(conn_id))
+		return(-1);
 #endif
 	return(1);
 }
@@ -486,6 +627,200 @@ static void dump_list()
 }
 */
 
+#ifdef DIM_EPOLL
+/* Each IO thread waits on its own epoll set: channels are added once when
+ * their connection starts reading or listening (enable_sig) and removed in
+ * tcpip_close(), so waiting and dispatching only cost the number of ready
+ * connections. Each event carries the conn_id and the channel, events for a
+ * connection that was closed (and possibly reused) in the meantime, or that
+ * is now served by another IO thread, are dropped. The wake-up pipe is
+ * registered with conn_id 0. The calling IO thread's set is Curr_reactor.
+ */
+#define MAX_EPOLL_EVENTS	256
+
+static int poll_create(IO_REACTOR *reactor)
+{
+	if(!reactor->events)
+	{
+		reactor->events = malloc(MAX_EPOLL_EVENTS * sizeof(struct epoll_event));
+		if(!reactor->events)
+			return 0;
+	}
+	if(reactor->epoll_fd == -1)
+	{
+		if( (reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1 )
+		{
+			perror("epoll_create");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void poll_destroy(IO_REACTOR *reactor)
+{
+	if(reactor->epoll_fd != -1)
+		close(reactor->epoll_fd);
+	reactor->epoll_fd = -1;
+	reactor->epoll_pipe = -1;
+	reactor->n_events = 0;
+	reactor->curr_event = 0;
+}
+
+static int poll_ctl(IO_REACTOR *reactor, int op, int conn_id, int fd)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	if(conn_id && Net_conns[conn_id].write_rout)
+		event.events |= EPOLLOUT;
+	event.data.u64 = ((unsigned long long)(unsigned)fd << 32) | (unsigned)conn_id;
+	return epoll_ctl(reactor->epoll_fd, op, fd, &event);
+}
+
+static int poll_add_conn(int conn_id)
+{
+	IO_REACTOR *reactor;
+
+	reactor = io_reactor_assign(conn_id);
+	if(!poll_create(reactor))
+		return 0;
+	if(poll_ctl(reactor, EPOLL_CTL_ADD, conn_id, Net_conns[conn_id].channel) == -1)
+	{
+		if(errno != EEXIST)
+		{
+#ifdef DEBUG
+			printf("epoll_ctl(ADD) failed on conn %d\n", conn_id);
+#endif
+			return 0;
+		}
+		poll_ctl(reactor, EPOLL_CTL_MOD, conn_id, Net_conns[conn_id].channel);
+	}
+	return 1;
+}
+
+static void poll_rem_channel(IO_REACTOR *reactor, int channel)
+{
+	if(reactor->epoll_fd != -1)
+		epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, channel, NULL);
+}
+
+static int poll_add(int fd)
+{
+	IO_REACTOR *reactor = Curr_reactor;
+
+	if(reactor->epoll_pipe != fd)
+	{
+		if(!poll_create(reactor))
+			return 0;
+		if(reactor->epoll_pipe != -1)
+			epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, reactor->epoll_pipe, NULL);
+		if( (poll_ctl(reactor, EPOLL_CTL_ADD, 0, fd) == -1) && (errno != EEXIST) )
+			return 0;
+		reactor->epoll_pipe = fd;
+	}
+	return 1;
+}
+
+static int poll_test(int fd)
+{
+	IO_REACTOR *reactor = Curr_reactor;
+
+	if((reactor->epoll_pipe == fd) && reactor->pipe_ready)
+	{
+		reactor->pipe_ready = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static int poll_wait(int timeout)
+{
+	IO_REACTOR *reactor = Curr_reactor;
+	int i, ret;
+
+	reactor->n_events = 0;
+	reactor->curr_event = 0;
+	reactor->pipe_ready = 0;
+	if(!poll_create(reactor))
+		return -1;
+	ret = epoll_wait(reactor->epoll_fd, reactor->events, MAX_EPOLL_EVENTS, timeout);
+	if(ret > 0)
+	{
+		reactor->n_events = ret;
+		for(i = 0; i < ret; i++)
+		{
+			if(!(reactor->events[i].data.u64 & 0xFFFFFFFF))
+				reactor->pipe_ready = 1;
+		}
+	}
+	return ret;
+}
+
+static int list_to_fds( fd_set *fds )
+{
+	if(fds) {}
+	return(poll_create(Curr_reactor));
+}
+
+/* The connection returned by fds_get_entry() can be written to: call its
+ * write routine (once, it has to call tcpip_start_write() again if needed).
+ * Returns 0 if there is nothing to read on it.
+ */
+static int poll_do_write( int conn_id )
+{
+	IO_REACTOR *reactor = Curr_reactor;
+	void (*write_rout)();
+
+	if(!(reactor->curr_mask & EPOLLOUT))
+		return(1);
+	{
+	DISABLE_AST
+	write_rout = Net_conns[conn_id].write_rout;
+	Net_conns[conn_id].write_rout = 0;
+	if(write_rout)
+		poll_ctl(reactor, EPOLL_CTL_MOD, conn_id, Net_conns[conn_id].channel);
+	ENABLE_AST
+	}
+	if(write_rout)
+		write_rout(conn_id);
+	return(reactor->curr_mask & (EPOLLIN | EPOLLERR | EPOLLHUP));
+}
+
+static int fds_get_entry( fd_set *fds, int *conn_id ) 
+{
+	IO_REACTOR *reactor = Curr_reactor;
+	struct epoll_event *event;
+	int i, channel, found;
+
+	if(fds) {}
+	while(reactor->curr_event < reactor->n_events)
+	{
+		event = &reactor->events[reactor->curr_event++];
+		i = (int)(event->data.u64 & 0xFFFFFFFF);
+		channel = (int)(event->data.u64 >> 32);
+		found = 0;
+		/* the connection tables can be reallocated by other threads */
+		{
+		DISABLE_AST
+		if( (i > 0) && (i < Curr_N_Conns) && Dna_conns[i].busy &&
+			Net_conns[i].channel && (Net_conns[i].channel == channel) &&
+			(&Io_reactors[Net_conns[i].io_thread - 1] == reactor) )
+			found = 1;
+		ENABLE_AST
+		}
+		if(found)
+		{
+			*conn_id = i;
+			reactor->curr_mask = event->events;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#else
 #ifdef __linux__
 static struct pollfd *Pollfds = 0;
 static int Pollfd_size = 0;
@@ -574,13 +909,17 @@ static int list_to_fds( fd_set *fds )
 
 static int fds_get_entry( fd_set *fds, int *conn_id ) 
 {
-	int	i;
-
+	int	i, found = 0;
 #ifdef __linux__
 	int index = *conn_id;
+#endif
+
+	/* the connection tables can be reallocated by other threads */
+	DISABLE_AST
+#ifdef __linux__
 	if(fds) {}
 	index++;
-	for( i = index; i < Pollfd_size; i++ )
+	for( i = index; (i < Pollfd_size) && (i < Curr_N_Conns); i++ )
 	{
 		if( Dna_conns[i].busy && (
 		    (Pollfds[i].revents & POLLIN) || (Pollfds[i].revents & POLLHUP) ) ) 
@@ -589,11 +928,11 @@ static int fds_get_entry( fd_set *fds, int *conn_id )
 		    if(Net_conns[i].channel)
 		    {
 				*conn_id = i;
-				return 1;
+				found = 1;
+				break;
 			}
 		}
 	}
-	return 0;
 #else
 	for( i = 1; i < Curr_N_Conns; i++ )
 	{
@@ -603,13 +942,16 @@ static int fds_get_entry( fd_set *fds, int *conn_id )
 			if(Net_conns[i].channel)
 		    {
 				*conn_id = i;
-				return 1;
+				found = 1;
+				break;
 			}
 		}
 	}
-	return 0;
 #endif
+	ENABLE_AST
+	return(found);
 }
+#endif
 
 #if defined(__linux__) && !defined (darwin)
 
@@ -707,13 +1049,148 @@ static int get_bytes_to_read(int conn_id)
 	return(count);
 }
 
+/* Per connection read state, allocated once per connection slot and never
+ * freed (as the writer, see tcpip_get_writer()). The IO thread of a
+ * connection reads into the connection buffer without the DIM lock but
+ * with the reader lock held, tcpip_close() takes it before closing the
+ * channel, so that a channel (and the buffer, which is freed after
+ * tcpip_close()) is never released under a read.
+ */
+typedef struct {
+	void *lock;
+	int channel;
+	int gen;
+	int reading;
+} TCPIP_READER;
+
+static TCPIP_READER *reader_get( int conn_id, int *gen )
+{
+	TCPIP_READER *reader;
+
+	reader = (TCPIP_READER *)Net_conns[conn_id].reader;
+	if(!reader)
+	{
+		reader = (TCPIP_READER *)malloc(sizeof(TCPIP_READER));
+		if(!reader)
+			return(0);
+		reader->lock = dim_mutex_create();
+		reader->channel = 0;
+		reader->gen = 0;
+		reader->reading = 0;
+		Net_conns[conn_id].reader = reader;
+	}
+	if(reader->channel != Net_conns[conn_id].channel)
+	{
+		dim_mutex_lock(reader->lock);
+		reader->channel = Net_conns[conn_id].channel;
+		reader->gen++;
+		dim_mutex_unlock(reader->lock);
+	}
+	*gen = reader->gen;
+	return(reader);
+}
+
+static int reader_read( TCPIP_READER *reader, int gen, char *buffer, int size )
+{
+	/* Read from the connection of generation gen, without the DIM lock.
+	 * Returns -2 if the connection is gone.
+	 */
+	int len, err = 0;
+
+	dim_mutex_lock(reader->lock);
+	if((reader->gen != gen) || !reader->channel)
+	{
+		dim_mutex_unlock(reader->lock);
+		return(-2);
+	}
+	reader->reading = 1;
+	len = (int)readsock(reader->channel, buffer, (size_t)size, 0);
+	if(len < 0)
+		err = errno;
+	reader->reading = 0;
+	dim_mutex_unlock(reader->lock);
+	if(len < 0)
+		errno = err;
+	return(len);
+}
+
+static void reader_close( int conn_id, int channel )
+{
+	TCPIP_READER *reader;
+
+	reader = (TCPIP_READER *)Net_conns[conn_id].reader;
+	if(reader && reader->channel)
+	{
+		if(reader->reading)
+			shutdown(channel, 2);
+		dim_mutex_lock(reader->lock);
+		reader->channel = 0;
+		reader->gen++;
+		dim_mutex_unlock(reader->lock);
+	}
+}
+
+static int do_read_some( int conn_id )
+{
+	/* Read whatever is available, up to the buffer size, in one call
+	 * (see tcpip_start_read_some()). The socket is only probed for more
+	 * data when the buffer was filled, otherwise the poll loop will
+	 * report the channel again.
+	 * Called with the DIM lock held, IO threads release it while reading
+	 * so that they only wait for each other to dispatch what they read.
+	 */
+	int	len, size, gen, err;
+	char *buffer;
+	TCPIP_READER *reader = 0;
+
+	size = Net_conns[conn_id].size;
+	buffer = Net_conns[conn_id].buffer;
+	if(Threads_on)
+		reader = reader_get(conn_id, &gen);
+	if(reader)
+	{
+		DIM_UNLOCK
+		len = reader_read(reader, gen, buffer, size);
+		err = errno;
+		DIM_LOCK
+		errno = err;
+		if((len == -2) || (reader->gen != gen))
+			return 0;
+	}
+	else
+		len = (int)readsock(Net_conns[conn_id].channel, buffer, (size_t)size, 0);
+	if(len <= 0)
+	{
+#ifndef WIN32
+		if((len < 0) && ((errno == EINTR) || (errno == EAGAIN) ||
+			(errno == EWOULDBLOCK)))
+			return 0;
+#else
+		/* the socket may be made non-blocking by a writer meanwhile */
+		if((len < 0) && tcpip_would_block(WSAGetLastError()))
+			return 0;
+#endif
+		/* Connection closed by other side. */
+		Net_conns[conn_id].read_rout( conn_id, -1, 0 );
+		return 0;
+	}
+	Net_conns[conn_id].last_used = time(NULL);
+	Net_conns[conn_id].read_rout( conn_id, 1, len );
+	if((len < size) || !Net_conns[conn_id].channel)
+		return 0;
+	return get_bytes_to_read(conn_id);
+}
+
 static int do_read( int conn_id )
 {
 	/* There is 'data' pending, read it.
+	 * Returns the number of bytes still waiting on the socket.
 	 */
 	int	len, totlen, size, count;
 	char	*p;
 
+	if(Net_conns[conn_id].read_some)
+		return do_read_some(conn_id);
 	count = get_bytes_to_read(conn_id);
 	if(!count)
 	{
@@ -763,10 +1240,11 @@ static int do_read( int conn_id )
 
 	Net_conns[conn_id].last_used = time(NULL);
 	Net_conns[conn_id].read_rout( conn_id, 1, totlen );
-	return 1;
+	if(!Net_conns[conn_id].channel)
+		return 0;
+	return get_bytes_to_read(conn_id);
 }
 
-
 void do_accept( int conn_id )
 {
 	/* There is a 'connect' pending, serve it.
@@ -823,10 +1301,15 @@ void io_sig_handler(int num)
 #endif
 
 	if(num){}
+#ifdef DIM_EPOLL
+	Curr_reactor = &Io_reactors[0];
+#endif
 	do
 	{
 		list_to_fds( &rfds );
-#ifdef __linux__
+#ifdef DIM_EPOLL
+		selret = poll_wait(0);
+#elif defined(__linux__)
 		selret = poll(Pollfds, Pollfd_size, 0);
 #else
     timeout.tv_sec = 0;		/* Don't wait, just poll */
@@ -838,6 +1321,10 @@ void io_sig_handler(int num)
 			conn_id = 0;
 			while( (ret = fds_get_entry( &rfds, &conn_id )) > 0 ) 
 			{
+#ifdef DIM_EPOLL
+				if(!poll_do_write(conn_id))
+					continue;
+#endif
 				if( Net_conns[conn_id].reading )
 				{
 					count = 0;
@@ -845,8 +1332,7 @@ void io_sig_handler(int num)
 					{
 						if(Net_conns[conn_id].channel)
 						{
-							do_read( conn_id );
-							count = get_bytes_to_read(conn_id);
+							count = do_read( conn_id );
 						}
 						else
 						{
@@ -864,7 +1350,7 @@ void io_sig_handler(int num)
 	}while(selret > 0);
 }
 
-void tcpip_task( void *dummy)
+void tcpip_task( void *tag)
 {
 	/* wait for an IO signal, find out what is happening and
 	 * call the right routine to handle the situation.
@@ -875,10 +1361,19 @@ void tcpip_task( void *dummy)
 	fd_set efds;
 #endif
 	int	conn_id, ret, count;
+	int channel __attribute__((unused));
 #ifndef WIN32
 	int data;
 #endif
-	if(dummy){}
+#ifdef DIM_EPOLL
+	int index = (int)(dim_long)tag;
+
+	if((index < 0) || (index >= N_io_reactors))
+		index = 0;
+	Curr_reactor = &Io_reactors[index];
+#else
+	if(tag){}
+#endif
 	while(1)
 	{
 		while(!DIM_IO_valid)
@@ -891,8 +1386,10 @@ void tcpip_task( void *dummy)
 #else
 		pfds = &rfds;
 #endif
-		MY_FD_SET( DIM_IO_path[0], pfds );
-#ifdef __linux__
+		MY_FD_SET( Curr_reactor->io_path[0], pfds );
+#ifdef DIM_EPOLL
+		ret = poll_wait(-1);
+#elif defined(__linux__)
 		ret = poll(Pollfds, Pollfd_size, -1);
 #else
 		ret = select(FD_SETSIZE, &rfds, NULL, &efds, NULL);
@@ -903,14 +1400,14 @@ void tcpip_task( void *dummy)
 		}
 		if(ret > 0)
 		{
-			if(MY_FD_ISSET(DIM_IO_path[0], pfds) )
+			if(MY_FD_ISSET(Curr_reactor->io_path[0], pfds) )
 			{
 #ifndef WIN32
         int retval __attribute__((unused));
-				retval = read(DIM_IO_path[0], &data, 4);
-				DIM_IO_Done = 0;
+				retval = read(Curr_reactor->io_path[0], &data, 4);
+				Curr_reactor->io_done = 0;
 #endif
-				MY_FD_CLR( (unsigned)DIM_IO_path[0], pfds );
+				MY_FD_CLR( (unsigned)Curr_reactor->io_path[0], pfds );
 			}
 /*
 			{
@@ -919,31 +1416,25 @@ void tcpip_task( void *dummy)
 			conn_id = 0;
 			while( (ret = fds_get_entry( &rfds, &conn_id )) > 0 ) 
 			{
-				if( Net_conns[conn_id].reading )
+#ifdef DIM_EPOLL
+				if(!poll_do_write(conn_id))
+					continue;
+#endif
+				do
 				{
+					DISABLE_AST
 					count = 0;
-					do
+					if(Net_conns[conn_id].channel)
 					{
-						DISABLE_AST
-						if(Net_conns[conn_id].channel)
-						{
-							do_read( conn_id );
-							count = get_bytes_to_read(conn_id);
-						}
+						if( Net_conns[conn_id].reading )
+							count = do_read( conn_id );
 						else
-						{
-							count = 0;
-						}
-						ENABLE_AST
-					}while(count > 0 );
-				}
-				else
-				{
-					DISABLE_AST
-					do_accept( conn_id );
+							do_accept( conn_id );
+					}
+					channel = Net_conns[conn_id].channel;
 					ENABLE_AST
-				}
-				MY_FD_CLR( (unsigned)Net_conns[conn_id].channel, &rfds );
+				}while(count > 0 );
+				MY_FD_CLR( (unsigned)channel, &rfds );
 			}
 /*
 			ENABLE_AST
@@ -966,6 +1457,7 @@ int tcpip_start_read( int conn_id, char *buffer, int size, void (*ast_routine)()
 	Net_conns[conn_id].read_rout = ast_routine;
 	Net_conns[conn_id].buffer = buffer;
 	Net_conns[conn_id].size = size;
+	Net_conns[conn_id].read_some = 0;
 	if(Net_conns[conn_id].reading == -1)
 	{
 		if(enable_sig( conn_id ) == -1)
@@ -980,6 +1472,19 @@ int tcpip_start_read( int conn_id, char *buffer, int size, void (*ast_routine)()
 	return(1);
 }
 
+int tcpip_start_read_some( int conn_id, char *buffer, int size,
+	void (*ast_routine)() )
+{
+	/* As tcpip_start_read(), but ast_routine is called with whatever
+	 * arrived, from 1 up to size bytes, instead of exactly size bytes.
+	 */
+	int ret;
+
+	if( (ret = tcpip_start_read(conn_id, buffer, size, ast_routine)) )
+		Net_conns[conn_id].read_some = 1;
+	return(ret);
+}
+
 int check_node_addr( char *node, unsigned char *ipaddr)
 {
 unsigned char *ptr;
@@ -1517,9 +2022,304 @@ printf("Writing %d, ret = %d\n", size, ret);
 	return(wrote);
 }
 
+int tcpip_start_write( int conn_id, void (*write_rout)() )
+{
+	/* Have write_rout(conn_id) called (once, without the DIM lock) when the
+	 * connection can be written to. Returns 1 if it will be called by the IO
+	 * thread of the connection when the socket is writable, 0 if it will
+	 * just be called as soon as possible (by the timer thread), in which case
+	 * it may have to wait for the socket.
+	 */
+#ifdef DIM_EPOLL
+	IO_REACTOR *reactor;
+
+	if(Threads_on && Net_conns[conn_id].io_thread && Net_conns[conn_id].channel)
+	{
+		reactor = &Io_reactors[Net_conns[conn_id].io_thread - 1];
+		Net_conns[conn_id].write_rout = write_rout;
+		if(poll_ctl(reactor, EPOLL_CTL_MOD, conn_id, Net_conns[conn_id].channel) != -1)
+			return(1);
+		Net_conns[conn_id].write_rout = 0;
+	}
+#endif
+	dtq_start_timer(0, write_rout, conn_id);
+	return(0);
+}
+
+/* Per connection write state. It is allocated once per connection slot and
+ * never freed, so a thread holding only the writer lock (and not the DIM
+ * lock) can safely write to the connection: the channel is only changed
+ * with the writer lock held and each (re)use of the slot gets a new
+ * generation, which writes are checked against.
+ */
+typedef struct {
+	void *lock;
+	int channel;
+	int gen;
+	int sending;
+} TCPIP_WRITER;
+
+/* Get the writer of a connection and its current generation
+ * (with the DIM lock held).
+ */
+void *tcpip_get_writer( int conn_id, int *gen )
+{
+	TCPIP_WRITER *writer;
+
+	writer = (TCPIP_WRITER *)Net_conns[conn_id].writer;
+	if(!writer)
+	{
+		writer = (TCPIP_WRITER *)malloc(sizeof(TCPIP_WRITER));
+		writer->lock = dim_mutex_create();
+		writer->channel = 0;
+		writer->gen = 0;
+		writer->sending = 0;
+		Net_conns[conn_id].writer = writer;
+	}
+	if(writer->channel != Net_conns[conn_id].channel)
+	{
+		dim_mutex_lock(writer->lock);
+		writer->channel = Net_conns[conn_id].channel;
+		writer->gen++;
+		dim_mutex_unlock(writer->lock);
+	}
+	*gen = writer->gen;
+	return((void *)writer);
+}
+
+/* Is this still the same connection (with the DIM lock held) */
+int tcpip_is_writer( int conn_id, void *writer, int gen )
+{
+	if((Net_conns[conn_id].writer == writer) &&
+	   (((TCPIP_WRITER *)writer)->gen == gen) &&
+	   (((TCPIP_WRITER *)writer)->channel == Net_conns[conn_id].channel))
+		return(1);
+	return(0);
+}
+
+static int writer_wait( int channel )
+{
+	/* Wait (at most the write timeout) for the channel to be writable */
+#ifdef __linux__
+	struct pollfd pollitem;
+
+	pollitem.fd = channel;
+	pollitem.events = POLLOUT;
+	pollitem.revents = 0;
+	return(poll(&pollitem, 1, Write_timeout*1000));
+#else
+	struct timeval	timeout;
+	fd_set wfds;
+
+	timeout.tv_sec = Write_timeout;
+	timeout.tv_usec = 0;
+	FD_ZERO(&wfds);
+	FD_SET( channel, &wfds);
+	return(select(FD_SETSIZE, NULL, &wfds, NULL, &timeout));
+#endif
+}
+
+#ifdef WIN32
+static int writer_writev( int channel, TCPIP_IOVEC *iov, int n_iov, int nowait,
+						 int *written )
+{
+	int wrote, n, size, err;
+	char *p;
+	int tcpip_would_block();
+
+	*written = 0;
+	if(nowait == 2)
+		nowait = 0;
+	for( ; n_iov > 0; iov++, n_iov--)
+	{
+		p = iov->base;
+		size = iov->size;
+		while(size > 0)
+		{
+			n = (size > Tcpip_max_io_data_write) ? Tcpip_max_io_data_write : size;
+			if(!nowait)
+			{
+				wrote = (int)writesock( channel, p, (size_t)n, 0 );
+				if( wrote == -1 )
+					return(0);
+			}
+			else
+			{
+				set_non_blocking(channel);
+				wrote = (int)writesock( channel, p, (size_t)n, 0 );
+				err = WSAGetLastError();
+				set_blocking(channel);
+				if(wrote == -1)
+				{
+					if(!tcpip_would_block(err))
+						return(0);
+					if(writer_wait(channel) <= 0)
+						return(-1);
+					wrote = (int)writesock( channel, p, (size_t)n, 0 );
+					if( wrote == -1 ) 
+						return(0);
+				}
+			}
+			p += wrote;
+			size -= wrote;
+			*written += wrote;
+		}
+	}
+	return(1);
+}
+#else
+/* Non-blocking writes use MSG_DONTWAIT where there is one, rather than
+ * switching the socket to O_NONBLOCK, which would also make the reads of
+ * the IO thread, that run at the same time, non-blocking.
+ */
+#ifdef MSG_DONTWAIT
+#ifdef MSG_NOSIGNAL
+#define WRITER_FLAGS	MSG_NOSIGNAL
+#else
+#define WRITER_FLAGS	0
+#endif
+#endif
+
+static int writer_writev( int channel, TCPIP_IOVEC *iov, int n_iov, int nowait,
+						 int *written )
+{
+	/* Write all the pieces with as few system calls as possible, each
+	 * taking at most TCPIP_MAX_IOV pieces and Tcpip_max_io_data_write bytes.
+	 * If nowait is 2 only write what can be written without waiting.
+	 */
+	struct iovec vec[TCPIP_MAX_IOV];
+	int wrote, n, size, total, err, off = 0;
+	int tcpip_would_block();
+#ifdef MSG_DONTWAIT
+	struct msghdr msg;
+#endif
+
+	*written = 0;
+	while(n_iov > 0)
+	{
+		total = 0;
+		for(n = 0; (n < n_iov) && (n < TCPIP_MAX_IOV) &&
+			(total < Tcpip_max_io_data_write); n++)
+		{
+			size = iov[n].size;
+			vec[n].iov_base = iov[n].base;
+			if(!n)
+			{
+				size -= off;
+				vec[n].iov_base = iov[n].base + off;
+			}
+			if(total + size > Tcpip_max_io_data_write)
+				size = Tcpip_max_io_data_write - total;
+			vec[n].iov_len = (size_t)size;
+			total += size;
+		}
+#ifdef MSG_DONTWAIT
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = vec;
+		msg.msg_iovlen = n;
+		wrote = (int)sendmsg(channel, &msg,
+			nowait ? (WRITER_FLAGS | MSG_DONTWAIT) : WRITER_FLAGS);
+		err = errno;
+#else
+		if(nowait)
+			set_non_blocking(channel);
+		wrote = (int)writev(channel, vec, n);
+		err = errno;
+		if(nowait)
+			set_blocking(channel);
+#endif
+		if(wrote == -1)
+		{
+			errno = err;
+			if(!nowait || !tcpip_would_block(err))
+				return(0);
+			if(nowait == 2)
+				return(1);
+			if(writer_wait(channel) <= 0)
+				return(-1);
+			continue;
+		}
+		*written += wrote;
+		while((n_iov > 0) && (wrote >= iov->size - off))
+		{
+			wrote -= iov->size - off;
+			off = 0;
+			iov++;
+			n_iov--;
+		}
+		off += wrote;
+	}
+	return(1);
+}
+#endif
+
+static int writer_send( TCPIP_WRITER *writer, int gen, TCPIP_IOVEC *iov,
+					   int n_iov, int nowait, int *written )
+{
+	int ret, err = 0;
+
+	*written = 0;
+	dim_mutex_lock(writer->lock);
+	if((writer->gen != gen) || !writer->channel)
+	{
+		dim_mutex_unlock(writer->lock);
+		return(2);
+	}
+	writer->sending = 1;
+	ret = writer_writev(writer->channel, iov, n_iov, nowait, written);
+	if(ret != 1)
+		err = errno;
+	writer->sending = 0;
+	dim_mutex_unlock(writer->lock);
+	if(ret != 1)
+		errno = err;
+	return(ret);
+}
+
+/* Write the pieces of iov to the connection of the writer, as long as it is
+ * still the connection of generation gen. To be called without the DIM lock
+ * (or with it, but never take it while writing). Returns 1 if written, 2 if
+ * the connection is gone, -1 on timeout and 0 on error (errno is kept for
+ * the caller to report).
+ */
+int tcpip_writer_sendv( void *writer, int gen, TCPIP_IOVEC *iov, int n_iov,
+					   int nowait )
+{
+	int written;
+
+	return(writer_send((TCPIP_WRITER *)writer, gen, iov, n_iov, nowait, &written));
+}
+
+/* As tcpip_writer_sendv() but only writes what the socket takes without
+ * waiting, *written tells how much. Returns 1 unless there was an error.
+ */
+int tcpip_writer_sendv_some( void *writer, int gen, TCPIP_IOVEC *iov, int n_iov,
+						int *written )
+{
+	return(writer_send((TCPIP_WRITER *)writer, gen, iov, n_iov, 2, written));
+}
+
+static void writer_close( int conn_id, int channel )
+{
+	TCPIP_WRITER *writer;
+
+	writer = (TCPIP_WRITER *)Net_conns[conn_id].writer;
+	if(writer && writer->channel)
+	{
+		/* wake up a writer waiting for the peer before taking its lock */
+		if(writer->sending)
+			shutdown(channel, 2);
+		dim_mutex_lock(writer->lock);
+		writer->channel = 0;
+		writer->gen++;
+		dim_mutex_unlock(writer->lock);
+	}
+}
+
 int tcpip_close( int conn_id )
 {
 	int channel;
+	IO_REACTOR *reactor;
 	/* Clear all traces of the connection conn_id.
 	 */
 	if(Net_conns[conn_id].timr_ent)
@@ -1529,11 +2329,24 @@ int tcpip_close( int conn_id )
 	}
 	channel = Net_conns[conn_id].channel;
 	Net_conns[conn_id].channel = 0;
+	Net_conns[conn_id].write_rout = 0;
 	Net_conns[conn_id].port = 0;
 	Net_conns[conn_id].node[0] = 0;
 	Net_conns[conn_id].task[0] = 0;
+	if(Net_conns[conn_id].io_thread)
+	{
+		reactor = &Io_reactors[Net_conns[conn_id].io_thread - 1];
+		reactor->n_conns--;
+		Net_conns[conn_id].io_thread = 0;
+#ifdef DIM_EPOLL
+		if(channel)
+			poll_rem_channel(reactor, channel);
+#endif
+	}
 	if(channel)
 	{
+		reader_close(conn_id, channel);
+		writer_close(conn_id, channel);
 		if(Net_conns[conn_id].write_timedout)
 		{
 			Net_conns[conn_id].write_timedout = 0;
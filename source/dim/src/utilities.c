@@ -305,3 +305,14 @@ int get_write_tmout()
 		return(atoi(p));
 	}
 }
+
+int get_io_threads()
+{
+	char	*p;
+
+	if( (p = getenv("DIM_IO_THREADS")) == NULL )
+		return(0);
+	else {
+		return(atoi(p));
+	}
+}
@@ -31,6 +31,7 @@
 // -- dqm4hep headers
 #include "dqm4hep/NetBuffer.h"
 #include "dqm4hep/RequestHandler.h"
+#include "dqm4hep/ServerInfo.h"
 #include "dqm4hep/Service.h"
 #include "dqm4hep/ServiceHandler.h"
 #include "dqm4hep/json.h"
@@ -40,6 +41,14 @@
 
 // -- std headers
 #include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace dqm4hep {
 
@@ -73,6 +82,15 @@ namespace dqm4hep {
        */
       void queryServerInfo(const std::string &serverName, core::json &serverInfo) const;
 
+      /**
+       *  @brief  Query server information in the compact binary encoding.
+       *          Return false if the server did not answer
+       *
+       *  @param  serverName the server name
+       *  @param  serverInfo the decoded server information
+       */
+      bool queryServerInfo(const std::string &serverName, ServerInfo &serverInfo) const;
+
       /**
        *  @brief  Send a command. Do not wait for any response
        *
@@ -92,6 +110,28 @@ namespace dqm4hep {
       template <typename Operation>
       void sendRequest(const std::string &name, const Buffer &request, Operation operation) const;
 
+      /**
+       *  @brief  Send a request without waiting for the server response.
+       *          Many requests can be in flight on the same request handler.
+       *          The operation is called from the dim thread on response reception,
+       *          or with an empty buffer if the server is not reachable
+       *
+       *  @param  name the request name
+       *  @param  request the request to send
+       *  @param  operation the callback operation to perform on data reception
+       */
+      template <typename Operation>
+      void sendRequestAsync(const std::string &name, const Buffer &request, Operation operation) const;
+
+      /**
+       *  @brief  Send a request without waiting for the server response.
+       *          The returned buffer owns a copy of the response
+       *
+       *  @param  name the request name
+       *  @param  request the request to send
+       */
+      std::future<Buffer> sendRequestAsync(const std::string &name, const Buffer &request) const;
+
       /**
        *  @brief  Send a command.
        *
@@ -151,10 +191,145 @@ namespace dqm4hep {
        */
       void notifyServerOnExit(const std::string &serverName);
 
+    private:
+      /** RpcChannel class.
+       *
+       *  A persistent dim rpc stub bound to one request handler name.
+       *  The rpc output service subscription is kept alive between
+       *  requests, so a repeated request costs a single round trip.
+       */
+      class RpcChannel : public DimRpcInfo {
+      public:
+        /**
+         *  @brief  Constructor
+         *
+         *  @param  name the request handler name
+         */
+        RpcChannel(const std::string &name);
+        RpcChannel(const RpcChannel &) = delete;
+        RpcChannel &operator=(const RpcChannel &) = delete;
+
+        /**
+         *  @brief  Send a request and wait for the server reply
+         *
+         *  @param  request the request to send
+         *  @return whether the reply came from the server (false on no-link)
+         */
+        bool sendRequest(const Buffer &request);
+
+        /**
+         *  @brief  Get the last reply received from the server
+         */
+        const std::vector<char> &response() const;
+
+        /**
+         *  @brief  The mutex serializing the requests sent on this channel
+         */
+        std::mutex &mutex();
+
+      private:
+        /**
+         *  @brief  The dim rpc handler. Copies the reply out of the dim receive buffer
+         */
+        void rpcInfoHandler() override;
+
+      private:
+        std::mutex m_mutex = {};                  ///< Serializes the requests sent on this channel
+        std::mutex m_replyMutex = {};             ///< Protects the reply state
+        std::condition_variable m_replyCond = {}; ///< Signaled on reply reception
+        std::vector<char> m_response = {};        ///< The last reply contents
+        bool m_replied = {false};                 ///< Whether the pending request got its reply
+        bool m_linked = {false};                  ///< Whether the last reply came from the server
+      };
+
+      typedef std::function<void(const Buffer &)> ResponseFunction;
+
+      /** AsyncRpcChannel class.
+       *
+       *  A pipelined rpc channel bound to one request handler name.
+       *  Each request is tagged with a correlation id (unique in the process,
+       *  as channels of the same name share their dim subscription), echoed by the
+       *  server in the response, so many requests can be in flight
+       *  without blocking any thread.
+       */
+      class AsyncRpcChannel : public DimInfo {
+      public:
+        /**
+         *  @brief  Constructor
+         *
+         *  @param  name the request handler name
+         */
+        AsyncRpcChannel(const std::string &name);
+        AsyncRpcChannel(const AsyncRpcChannel &) = delete;
+        AsyncRpcChannel &operator=(const AsyncRpcChannel &) = delete;
+
+        /**
+         *  @brief  Destructor. Pending requests are discarded
+         */
+        ~AsyncRpcChannel();
+
+        /**
+         *  @brief  Send a request. The function is called on response reception
+         *
+         *  @param  request the request to send
+         *  @param  function the function to call with the response
+         */
+        void sendRequest(const Buffer &request, ResponseFunction function);
+
+      private:
+        /**
+         *  @brief  The dim info handler. Dispatches the response to the pending request
+         */
+        void infoHandler() override;
+
+      private:
+        enum State { CONNECTING, CONNECTED, DOWN };
+
+        typedef std::map<uint32_t, ResponseFunction> PendingRequestMap;
+        typedef std::map<uint32_t, std::string> QueuedRequestMap;
+
+        std::string m_rpcInName = {""};             ///< The rpc input (command) name
+        std::mutex m_mutex = {};                    ///< Protects the channel state
+        State m_state = {CONNECTING};               ///< The output subscription state
+        PendingRequestMap m_pendingRequests = {};   ///< The requests waiting for a response
+        QueuedRequestMap m_queuedRequests = {};     ///< The requests waiting for the subscription
+      };
+
+      typedef std::shared_ptr<RpcChannel> RpcChannelPtr;
+      typedef std::map<std::string, RpcChannelPtr> RpcChannelMap;
+      typedef std::shared_ptr<AsyncRpcChannel> AsyncRpcChannelPtr;
+      typedef std::map<std::string, AsyncRpcChannelPtr> AsyncRpcChannelMap;
+
+      /**
+       *  @brief  Get the cached rpc channel for a request handler, opening it if needed
+       *
+       *  @param  name the request handler name
+       */
+      RpcChannelPtr rpcChannel(const std::string &name) const;
+
+      /**
+       *  @brief  Remove an rpc channel from the cache, e.g after its server has exited.
+       *          The next request on this name opens a fresh channel
+       *
+       *  @param  name the request handler name
+       *  @param  channel the channel to remove
+       */
+      void closeRpcChannel(const std::string &name, const RpcChannelPtr &channel) const;
+
+      /**
+       *  @brief  Get the cached pipelined rpc channel for a request handler, opening it if needed
+       *
+       *  @param  name the request handler name
+       */
+      AsyncRpcChannelPtr asyncRpcChannel(const std::string &name) const;
+
     private:
       typedef std::map<std::string, ServiceHandler *> ServiceHandlerMap;
       typedef std::vector<ServiceHandler *> ServiceHandlerList;
       ServiceHandlerMap m_serviceHandlerMap = {}; ///< The service map
+      mutable RpcChannelMap m_rpcChannelMap = {};           ///< The cached rpc channels, by request name
+      mutable AsyncRpcChannelMap m_asyncRpcChannelMap = {}; ///< The cached pipelined rpc channels, by request name
+      mutable std::mutex m_rpcChannelMutex = {};            ///< Protects the rpc channel maps
     };
 
     //-------------------------------------------------------------------------------------------------
@@ -163,53 +338,51 @@ namespace dqm4hep {
 
     template <typename Request>
     inline void Client::sendRequest(const std::string &name, const Request &request) const {
-      DimRpcInfo rpcInfo(const_cast<char *>(name.c_str()), (void *)nullptr, 0);
       Buffer contents;
-      auto model = contents.createModel<Request>();
-      model->copy(request);
-      contents.setModel(model);
-      rpcInfo.setData((void *)contents.begin(), contents.size());
+      contents.copy(request);
+      this->sendRequest(name, contents);
     }
 
     //-------------------------------------------------------------------------------------------------
 
     template <>
     inline void Client::sendRequest(const std::string &name, const Buffer &request) const {
-      DimRpcInfo rpcInfo(const_cast<char *>(name.c_str()), (void *)nullptr, 0);
-      Buffer contents;
-      contents.adopt(request.begin(), request.size());
-      rpcInfo.setData((void *)contents.begin(), contents.size());
+      // no response expected: write directly on the rpc input, no need for an output subscription
+      const std::string rpcInName(name + "/RpcIn");
+      DimClient::sendCommand(rpcInName.c_str(), (void *)request.begin(), request.size());
     }
 
     //-------------------------------------------------------------------------------------------------
 
     template <typename Operation>
     inline void Client::sendRequest(const std::string &name, const Buffer &request, Operation operation) const {
-      DimRpcInfo rpcInfo(const_cast<char *>(name.c_str()), (void *)nullptr, 0);
-
-      // send request
-      rpcInfo.setData((void *)request.begin(), request.size());
-
-      // wait for answer from server
-      char *data = (char *)rpcInfo.getData();
-      int size = rpcInfo.getSize();
+      auto channel = this->rpcChannel(name);
+      std::lock_guard<std::mutex> lock(channel->mutex());
 
+      // send request and wait for answer from server
       Buffer response;
 
-      if (nullptr != data && 0 != size)
-        response.adopt(data, size);
+      if (!channel->sendRequest(request))
+        this->closeRpcChannel(name, channel);
+      else if (!channel->response().empty())
+        response.adopt(channel->response().data(), channel->response().size());
 
       operation(response);
     }
 
     //-------------------------------------------------------------------------------------------------
 
+    template <typename Operation>
+    inline void Client::sendRequestAsync(const std::string &name, const Buffer &request, Operation operation) const {
+      this->asyncRpcChannel(name)->sendRequest(request, ResponseFunction(operation));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     template <typename Command>
     inline void Client::sendCommand(const std::string &name, const Command &command, bool blocking) const {
       Buffer contents;
-      auto model = contents.createModel<Command>();
-      model->copy(command);
-      contents.setModel(model);
+      contents.copy(command);
 
       if (blocking) {
         DimClient::sendCommand(const_cast<char *>(name.c_str()), (void *)contents.begin(), contents.size());
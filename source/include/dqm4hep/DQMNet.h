@@ -31,7 +31,9 @@
 // interface headers
 #include <dqm4hep/Client.h>
 #include <dqm4hep/NetBuffer.h>
+#include <dqm4hep/Publisher.h>
 #include <dqm4hep/Server.h>
+#include <dqm4hep/ServerInfo.h>
 #include <dqm4hep/Service.h>
 
 #endif //  DQMNET_H
@@ -35,7 +35,9 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <typeinfo>
+#include <vector>
 
 namespace dqm4hep {
 
@@ -52,6 +54,69 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
+    /**
+     *  @brief  BufferModelPool class.
+     *          Thread local free lists of memory blocks for the buffer models,
+     *          one per block size class. Large blocks bypass the pool
+     */
+    class BufferModelPool {
+    public:
+      /**
+       *  @brief  Get a memory block of at least the given size
+       *
+       *  @param  size the block size
+       */
+      static void *allocate(size_t size);
+
+      /**
+       *  @brief  Give back a memory block to the pool of the calling thread
+       *
+       *  @param  ptr the block address
+       *  @param  size the block size, as passed to allocate()
+       */
+      static void deallocate(void *ptr, size_t size);
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    /**
+     *  @brief  BufferModelAllocator class.
+     *          Allocator drawing the buffer models from the BufferModelPool
+     */
+    template <typename T>
+    class BufferModelAllocator {
+    public:
+      typedef T value_type;
+
+      BufferModelAllocator() = default;
+
+      template <typename U>
+      BufferModelAllocator(const BufferModelAllocator<U> &) {
+      }
+
+      T *allocate(size_t n) {
+        return static_cast<T *>(BufferModelPool::allocate(n * sizeof(T)));
+      }
+
+      void deallocate(T *ptr, size_t n) {
+        BufferModelPool::deallocate(ptr, n * sizeof(T));
+      }
+    };
+
+    template <typename T, typename U>
+    inline bool operator==(const BufferModelAllocator<T> &, const BufferModelAllocator<U> &) {
+      return true;
+    }
+
+    template <typename T, typename U>
+    inline bool operator!=(const BufferModelAllocator<T> &, const BufferModelAllocator<U> &) {
+      return false;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
     /**
      *  @brief  RawBuffer class
      */
@@ -98,6 +163,76 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
+    class Payload;
+    typedef std::shared_ptr<const Payload> PayloadPtr;
+
+    /**
+     *  @brief  Payload class.
+     *          Owned and immutable contents, shared by reference counting between
+     *          consumers and threads without further copy
+     */
+    class Payload {
+    public:
+      /**
+       *  @brief  Create a payload from a copy of a buffer
+       *
+       *  @param  buffer the start address of the buffer to copy
+       *  @param  size the size of the buffer to copy
+       */
+      static PayloadPtr create(const char *buffer, size_t size);
+
+      /**
+       *  @brief  Create a payload taking over the string contents
+       *
+       *  @param  contents the string to move in the payload
+       */
+      static PayloadPtr create(std::string &&contents);
+
+      /**
+       *  @brief  Constructor. Use create() instead
+       *
+       *  @param  contents the payload contents
+       */
+      explicit Payload(std::string &&contents);
+      Payload(const Payload &) = delete;
+      Payload &operator=(const Payload &) = delete;
+
+      /**
+       *  @brief  Get the payload begin address
+       */
+      const char *begin() const;
+
+      /**
+       *  @brief  Get the payload end address
+       */
+      const char *end() const;
+
+      /**
+       *  @brief  Get the payload size
+       */
+      size_t size() const;
+
+    private:
+      const std::string m_contents; ///< The payload contents
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    /**
+     *  @brief  BufferSegment struct.
+     *          One contiguous part of a segmented buffer (iovec like)
+     */
+    struct BufferSegment {
+      const char *address; ///< The segment start address
+      size_t size;         ///< The segment size
+    };
+
+    typedef std::vector<BufferSegment> BufferSegments;
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
     /**
      *  @brief  BufferModel class
      */
@@ -185,16 +320,74 @@ namespace dqm4hep {
       std::string m_value = {""}; ///< An internal copy of the stored value as std::string
     };
 
+    /**
+     *  @brief  BufferModelT class specialization (std::vector<char>).
+     *          Use move() to take over a large buffer without copying it
+     */
+    template <>
+    class BufferModelT<std::vector<char>> : public BufferModel {
+    public:
+      inline BufferModelT() {
+        m_rawBuffer.adopt(NullBuffer::buffer, NullBuffer::size);
+      }
+
+      inline void copy(const std::vector<char> &value) {
+        m_value = value;
+        m_rawBuffer.adopt(m_value.data(), m_value.size());
+      }
+
+      inline void move(std::vector<char> &&value) {
+        m_value = std::move(value);
+        m_rawBuffer.adopt(m_value.data(), m_value.size());
+      }
+
+    private:
+      std::vector<char> m_value = {}; ///< The stored buffer
+    };
+
+    /**
+     *  @brief  BufferModelT class specialization (PayloadPtr).
+     *          Share an immutable payload without copying it
+     */
+    template <>
+    class BufferModelT<PayloadPtr> : public BufferModel {
+    public:
+      inline BufferModelT() {
+        m_rawBuffer.adopt(NullBuffer::buffer, NullBuffer::size);
+      }
+
+      inline void copy(const PayloadPtr &value) {
+        m_value = value;
+        m_rawBuffer.adopt(m_value->begin(), m_value->size());
+      }
+
+      inline void move(PayloadPtr &&value) {
+        m_value = std::move(value);
+        m_rawBuffer.adopt(m_value->begin(), m_value->size());
+      }
+
+    private:
+      PayloadPtr m_value = {nullptr}; ///< The shared payload
+    };
+
     typedef std::shared_ptr<BufferModel> BufferModelPtr;
 
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
     /**
-     *  @brief  Buffer class
+     *  @brief  Buffer class.
+     *          Adopted buffers are kept as a plain view and small copied
+     *          contents are stored inline, both without heap allocation.
+     *          Models come from the thread local BufferModelPool.
+     *          A buffer can also be made of segments, sent without being
+     *          concatenated first. The contiguous accessors (begin(), end())
+     *          concatenate them once on demand
      */
     class Buffer {
     public:
+      static const size_t inlineCapacity = 64; ///< The maximum contents size stored inline by copy()
+
       Buffer(const Buffer &) = delete;
       Buffer &operator=(const Buffer &) = delete;
       Buffer &&operator=(Buffer &&) = delete;
@@ -221,6 +414,30 @@ namespace dqm4hep {
        */
       std::shared_ptr<BufferModel> createModel() const;
 
+      /**
+       *  @brief  Copy the raw bytes of the value, as BufferModelT<T>::copy() does.
+       *          Stored inline if small enough and trivially copyable, in a model otherwise
+       *
+       *  @param  value the value to copy
+       */
+      template <typename T>
+      void copy(const T &value);
+
+      /**
+       *  @brief  Copy the string contents. Stored inline if small enough, in a model otherwise
+       *
+       *  @param  value the string to copy
+       */
+      void copy(const std::string &value);
+
+      /**
+       *  @brief  Copy a buffer. Stored inline if small enough, in a model otherwise
+       *
+       *  @param  buffer the start address of the buffer to copy
+       *  @param  size the size of the buffer to copy
+       */
+      void copy(const char *buffer, size_t size);
+
       /**
        *  @brief  Set the new model to handle the buffer
        *
@@ -244,7 +461,48 @@ namespace dqm4hep {
       size_t size() const;
 
       /**
-       *  @brief  Adopt a new buffer. A new model is created to handle this new buffer
+       *  @brief  Share a payload. Kept as a view on the payload, no copy is made
+       *
+       *  @param  payload the payload to share
+       */
+      void share(PayloadPtr payload);
+
+      /**
+       *  @brief  Append a segment (does not own it !).
+       *          The previous contents is dropped if the buffer was not segmented
+       *
+       *  @param  buffer the segment start address
+       *  @param  size the segment size
+       */
+      void addSegment(const char *buffer, size_t size);
+
+      /**
+       *  @brief  Append a payload segment, kept alive by the buffer.
+       *          The previous contents is dropped if the buffer was not segmented
+       *
+       *  @param  payload the payload to append
+       */
+      void addSegment(PayloadPtr payload);
+
+      /**
+       *  @brief  Whether the buffer is made of segments
+       */
+      bool isSegmented() const;
+
+      /**
+       *  @brief  Get the segments of a segmented buffer
+       */
+      const BufferSegments &segments() const;
+
+      /**
+       *  @brief  Get the contents as a payload, to keep it beyond the buffer lifetime.
+       *          The contents is copied on first call only, unless already shared from a
+       *          payload: all consumers of the same buffer then share one payload
+       */
+      PayloadPtr payload() const;
+
+      /**
+       *  @brief  Adopt a new buffer (does not own it !). Kept as a view, no model is created
        *
        *  @param  buffer the start address of the new buffer to adopt
        *  @param  size the size of the new buffer to adopt
@@ -252,12 +510,36 @@ namespace dqm4hep {
       void adopt(const char *buffer, size_t size);
 
       /**
-       *  @brief  Get the model handling the raw buffer
+       *  @brief  Get the model handling the raw buffer.
+       *          A model is created on first call for views and inline contents
        */
       BufferModelPtr model() const;
 
     private:
-      BufferModelPtr m_model = {nullptr}; ///< The buffer model handling the raw buffer
+      /**
+       *  @brief  Whether the contents is stored inline
+       */
+      bool isInline() const;
+
+      /**
+       *  @brief  Concatenate the segments once in a payload viewed by the buffer
+       */
+      void flatten() const;
+
+      /**
+       *  @brief  Drop the segments
+       */
+      void clearSegments();
+
+    private:
+      typedef std::aligned_storage<inlineCapacity>::type InlineStorage;
+
+      mutable BufferModelPtr m_model = {nullptr}; ///< The buffer model handling the raw buffer, if any
+      mutable PayloadPtr m_payload = {nullptr};   ///< The payload viewed by the raw buffer, if any
+      mutable RawBuffer m_view = {};              ///< The raw buffer, if not handled by a model
+      BufferSegments m_segments = {};             ///< The segments of a segmented buffer
+      std::vector<PayloadPtr> m_segmentPayloads = {}; ///< The payloads kept alive by the segments
+      InlineStorage m_inlineStorage;              ///< The storage of small copied contents
     };
 
     //-------------------------------------------------------------------------------------------------
@@ -289,7 +571,21 @@ namespace dqm4hep {
 
     template <typename T>
     inline std::shared_ptr<BufferModelT<T>> Buffer::createModel() const {
-      return std::make_shared<BufferModelT<T>>();
+      return std::allocate_shared<BufferModelT<T>>(BufferModelAllocator<BufferModelT<T>>());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    template <typename T>
+    inline void Buffer::copy(const T &value) {
+      if (std::is_trivially_copyable<T>::value && sizeof(T) <= inlineCapacity) {
+        this->copy((const char *)&value, sizeof(T));
+        return;
+      }
+
+      auto m = this->createModel<T>();
+      m->copy(value);
+      this->setModel(m);
     }
   }
 }
@@ -0,0 +1,144 @@
+/// \file Publisher.h
+/*
+ *
+ * Publisher.h header template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/NetBuffer.h"
+#include "dqm4hep/Service.h"
+
+// -- std headers
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    /**
+     *  @brief  Publisher class.
+     *          A bounded queue of service updates sent to the clients by a
+     *          dedicated thread, so that a slow client never blocks the
+     *          thread calling Service::send*(). Owned by the Server
+     */
+    class Publisher {
+    public:
+      /**
+       *  @brief  What to do with an update queued while the queue is full
+       */
+      enum OverflowPolicy {
+        BLOCK,         ///< Wait for room in the queue
+        DROP_OLDEST,   ///< Drop the oldest queued update
+        DROP_NEWEST    ///< Drop the update being queued
+      };
+
+      /**
+       *  @brief  Constructor. Start the publisher thread
+       *
+       *  @param  maxQueueSize the maximum number of queued updates (at least 1)
+       *  @param  policy what to do when the queue is full
+       */
+      Publisher(size_t maxQueueSize, OverflowPolicy policy);
+      Publisher(const Publisher &) = delete;
+      Publisher &operator=(const Publisher &) = delete;
+
+      /**
+       *  @brief  Destructor. Drop the queued updates and join the publisher thread
+       */
+      ~Publisher();
+
+      /**
+       *  @brief  Queue a service update. The buffer must own its contents
+       *
+       *  @param  pService the service to update
+       *  @param  buffer the update contents
+       *  @param  clientIds the clients to update (all if empty)
+       */
+      void publish(Service *pService, Buffer &&buffer, const std::vector<int> &clientIds);
+
+      /**
+       *  @brief  Drop the queued updates of a service, and the one about to be sent if any.
+       *          Called before the service goes away. Does not wait for the publisher
+       *          thread, so it can be called from a dim callback
+       *
+       *  @param  pService the service
+       */
+      void discard(Service *pService);
+
+      /**
+       *  @brief  Get the maximum number of queued updates
+       */
+      size_t maxQueueSize() const;
+
+      /**
+       *  @brief  Get the overflow policy
+       */
+      OverflowPolicy overflowPolicy() const;
+
+      /**
+       *  @brief  Get the number of updates dropped because the queue was full
+       */
+      size_t nDroppedUpdates() const;
+
+    private:
+      /**
+       *  @brief  Update struct. A queued service update
+       */
+      struct Update {
+        Update(Service *pService, Buffer &&buffer, const std::vector<int> &clientIds);
+        Update(Update &&update) = default;
+
+        Service                *m_pService;   ///< The service to update
+        Buffer                  m_buffer;     ///< The update contents
+        std::vector<int>        m_clientIds;  ///< The clients to update (all if empty)
+      };
+
+      /**
+       *  @brief  The publisher thread loop
+       */
+      void run();
+
+    private:
+      const size_t              m_maxQueueSize;               ///< The maximum number of queued updates
+      const OverflowPolicy      m_policy;                     ///< What to do when the queue is full
+      std::deque<Update>        m_updates = {};               ///< The queued updates
+      Service                  *m_pSendingService = {nullptr}; ///< The service being updated by the thread, reset if discarded
+      size_t                    m_nDroppedUpdates = {0};      ///< The number of dropped updates
+      mutable std::mutex        m_mutex = {};                 ///< Protects the members above
+      std::condition_variable   m_queueCondition = {};        ///< Signaled on new update or stop
+      std::condition_variable   m_sentCondition = {};         ///< Signaled when an update has been taken or sent
+      bool                      m_stop = {false};             ///< Whether the thread has to exit
+      std::thread               m_thread = {};                ///< The publisher thread
+    };
+  }
+}
+
+#endif //  PUBLISHER_H
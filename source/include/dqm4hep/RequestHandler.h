@@ -31,10 +31,17 @@
 // -- dqm4hep headers
 #include "dqm4hep/NetBuffer.h"
 #include "dqm4hep/Signal.h"
+#include "dqm4hep/WorkerPool.h"
 #include "dqm4hep/json.h"
 
 // -- std headers
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 // -- dim headers
 #include "dis.hxx"
@@ -44,12 +51,17 @@ namespace dqm4hep {
   namespace net {
 
     class Server;
+    class Response;
+
+    typedef std::shared_ptr<Response> ResponsePtr;
 
     class RequestHandler {
       friend class Server;
+      friend class Response;
 
     public:
       typedef core::Signal<const Buffer &, Buffer &> RequestSignal;
+      typedef core::Signal<const Buffer &, ResponsePtr> DeferredRequestSignal;
 
       /**
        * Get the request name
@@ -61,6 +73,14 @@ namespace dqm4hep {
        */
       Server *server() const;
 
+      /**
+       * Get the name of the pipelined rpc of a request handler.
+       * Requests and responses on this rpc are prefixed by a correlation id
+       *
+       * @param name the request handler name
+       */
+      static std::string asyncRpcName(const std::string &name);
+
     private:
       /**
        * Constructor
@@ -72,6 +92,20 @@ namespace dqm4hep {
       RequestHandler(Server *pServer, const std::string &name, Controller *pController,
                      void (Controller::*function)(const Buffer &request, Buffer &response));
       
+      /**
+       * Constructor. The requests are run in the worker pool and the
+       * responses are sent whenever the handler completes them
+       *
+       * @param pServer the server managing the request handler
+       * @param name the request handler name
+       * @param pWorkerPool the worker pool running the requests
+       * @param maxConcurrency the maximum number of requests in flight for this handler
+       */
+      template <typename Controller>
+      RequestHandler(Server *pServer, const std::string &name, Controller *pController,
+                     void (Controller::*function)(const Buffer &request, ResponsePtr response),
+                     WorkerPool *pWorkerPool, unsigned int maxConcurrency);
+
       RequestHandler(const RequestHandler&) = delete;
       RequestHandler& operator=(const RequestHandler&) = delete;
 
@@ -124,7 +158,50 @@ namespace dqm4hep {
         RequestHandler *m_pHandler = {nullptr}; ///< The request handler owner instance
       };
 
+      /** AsyncRpc class.
+      *
+      *  The pipelined dim rpc implementation. The request and the
+      *  response carry the client correlation id in front of the data
+      */
+      class AsyncRpc : public DimRpc {
+      public:
+        /**
+         * Contructor
+         */
+        AsyncRpc(RequestHandler *pHandler);
+        AsyncRpc(const AsyncRpc&) = delete;
+        AsyncRpc& operator=(const AsyncRpc&) = delete;
+
+        /**
+         * The dim rpc handler
+         */
+        void rpcHandler() override;
+
+      private:
+        RequestHandler            *m_pHandler = {nullptr}; ///< The request handler owner instance
+        std::vector<DIS_SEGMENT>   m_segments = {};         ///< The reply segments (correlation id + response)
+      };
+
+      /** DeferredContext class.
+      *
+      *  The state shared by a deferred request handler, its tasks in
+      *  the worker pool and its pending responses. Outlives the handler
+      *  if a response is still held by the user
+      */
+      class DeferredContext {
+      public:
+        DeferredRequestSignal         m_signal = {};              ///< The deferred request signal
+        std::mutex                    m_mutex = {};               ///< Protects the members below
+        WorkerPool                   *m_pWorkerPool = {nullptr};  ///< The pool running the requests
+        Rpc                          *m_pRpc = {nullptr};         ///< The rpc to reply on, while handling requests
+        AsyncRpc                     *m_pAsyncRpc = {nullptr};    ///< The pipelined rpc to reply on, while handling requests
+        unsigned int                  m_maxConcurrency = {1};     ///< The maximum number of requests in flight
+        unsigned int                  m_nInFlight = {0};          ///< The number of requests in flight
+        std::deque<WorkerPool::Task>  m_queuedTasks = {};         ///< The requests waiting for a free slot
+      };
+
       friend class Rpc;
+      friend class AsyncRpc;
 
     private:
       /**
@@ -134,11 +211,82 @@ namespace dqm4hep {
        */
       void handleRequest(const Buffer &request, Buffer &response);
 
+      /**
+       * Whether the requests are run in the worker pool
+       */
+      bool isDeferred() const;
+
+      /**
+       * Queue a request for the worker pool. Called from the dim rpc handler
+       *
+       * @param data the request data, copied
+       * @param size the request size
+       * @param pipelined whether the request came from the pipelined rpc
+       * @param correlationId the client correlation id (pipelined rpc only)
+       */
+      void deferRequest(const char *data, int size, bool pipelined, uint32_t correlationId);
+
     private:
       std::string           m_name = {""};            ///< The request handler name
       Server               *m_pServer = {nullptr};         ///< The server in which the request handler is declared
       RequestSignal         m_requestSignal = {};
       Rpc                  *m_pRpc = {nullptr};
+      AsyncRpc             *m_pAsyncRpc = {nullptr};
+      std::shared_ptr<DeferredContext> m_deferredContext = {nullptr}; ///< The deferred mode state, if any
+    };
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    /**
+     *  @brief  Response class.
+     *          The response of a deferred request handler. Fill the buffer
+     *          and call send(), possibly later and from any thread.
+     *          The response is sent on destruction if send() was not called
+     */
+    class Response {
+      friend class RequestHandler;
+
+    public:
+      Response(const Response&) = delete;
+      Response& operator=(const Response&) = delete;
+
+      /**
+       *  @brief  Destructor. Send the response if not yet done
+       */
+      ~Response();
+
+      /**
+       *  @brief  Get the response buffer to fill
+       */
+      Buffer &buffer();
+
+      /**
+       *  @brief  Send the response to the client. Further calls are ignored
+       */
+      void send();
+
+    private:
+      /**
+       *  @brief  Constructor
+       *
+       *  @param  context the deferred request handler context
+       *  @param  clientId the dim id of the client to reply to
+       *  @param  pipelined whether to reply on the pipelined rpc
+       *  @param  correlationId the client correlation id (pipelined rpc only)
+       */
+      Response(std::shared_ptr<RequestHandler::DeferredContext> context, int clientId, bool pipelined,
+               uint32_t correlationId);
+
+    private:
+      std::shared_ptr<RequestHandler::DeferredContext>  m_context = {nullptr};  ///< The request handler context
+      int                                               m_clientId = {0};       ///< The client to reply to
+      bool                                              m_pipelined = {false};  ///< Whether to reply on the pipelined rpc
+      uint32_t                                          m_correlationId = {0};  ///< The client correlation id
+      Buffer                                            m_buffer = {};          ///< The response contents
+      std::atomic<bool>                                 m_sent = {false};       ///< Whether the response was sent
+      bool                                              m_holdsSlot = {false};  ///< Whether the request took a concurrency slot
     };
 
     //-------------------------------------------------------------------------------------------------
@@ -148,10 +296,23 @@ namespace dqm4hep {
     template <typename Controller>
     inline RequestHandler::RequestHandler(Server *pServer, const std::string &rname, Controller *pController,
                                           void (Controller::*function)(const Buffer &request, Buffer &response))
-        : m_name(rname), m_pServer(pServer), m_pRpc(nullptr) {
+        : m_name(rname), m_pServer(pServer), m_pRpc(nullptr), m_pAsyncRpc(nullptr) {
       m_requestSignal.connect(pController, function);
     }
 
+    //-------------------------------------------------------------------------------------------------
+
+    template <typename Controller>
+    inline RequestHandler::RequestHandler(Server *pServer, const std::string &rname, Controller *pController,
+                                          void (Controller::*function)(const Buffer &request, ResponsePtr response),
+                                          WorkerPool *pWorkerPool, unsigned int maxConcurrency)
+        : m_name(rname), m_pServer(pServer), m_pRpc(nullptr), m_pAsyncRpc(nullptr),
+          m_deferredContext(std::make_shared<DeferredContext>()) {
+      m_deferredContext->m_signal.connect(pController, function);
+      m_deferredContext->m_pWorkerPool = pWorkerPool;
+      m_deferredContext->m_maxConcurrency = std::max(1U, maxConcurrency);
+    }
+
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
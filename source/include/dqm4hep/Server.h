@@ -30,13 +30,21 @@
 
 // -- dqm4hep headers
 #include <dqm4hep/NetBuffer.h>
+#include <dqm4hep/Publisher.h>
 #include <dqm4hep/RequestHandler.h>
+#include <dqm4hep/ServerInfo.h>
 #include <dqm4hep/Service.h>
 #include <dqm4hep/Signal.h>
+#include <dqm4hep/WorkerPool.h>
 
 // -- dim headers
 #include <dis.hxx>
 
+// -- std headers
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 namespace dqm4hep {
 
   namespace net {
@@ -76,7 +84,10 @@ namespace dqm4hep {
       const std::string &name() const;
 
       /**
-       * @brief  Start serving services and handling requests
+       * @brief  Start serving services and handling requests.
+       *         The services, request handlers and command handlers created before
+       *         are checked against the dns in one query and registered in bulk.
+       *         Throw if one of them is already running on the network
        */
       void start();
 
@@ -114,6 +125,44 @@ namespace dqm4hep {
       void createRequestHandler(const std::string &name, Controller *pController,
                                 void (Controller::*function)(const Buffer &request, Buffer &response));
 
+      /**
+       *  @brief  Create a new deferred request handler.
+       *          The requests are run in the server worker pool, not in the dim thread.
+       *          The response can be completed and sent later, from any thread
+       *
+       *  @param  name the request handler name
+       *  @param  pController the class instance that will handle the request
+       *  @param  function the class method that will treat the request and complete the response
+       *  @param  maxConcurrency the maximum number of requests of this handler in flight at once
+       */
+      template <typename Controller>
+      void createRequestHandler(const std::string &name, Controller *pController,
+                                void (Controller::*function)(const Buffer &request, ResponsePtr response),
+                                unsigned int maxConcurrency = 1);
+
+      /**
+       *  @brief  Set the number of worker threads running the deferred request handlers.
+       *          Must be called before creating the first deferred request handler
+       *
+       *  @param  nWorkers the number of worker threads
+       */
+      void setNumberOfRequestWorkers(unsigned int nWorkers);
+
+      /**
+       *  @brief  Publish the service updates asynchronously: Service::send*() only queue
+       *          the update, written to the clients by a publisher thread owned by the server.
+       *          Can be enabled only once
+       *
+       *  @param  maxQueueSize the maximum number of queued updates
+       *  @param  policy what to do with an update queued while the queue is full
+       */
+      void setAsyncPublishing(size_t maxQueueSize, Publisher::OverflowPolicy policy);
+
+      /**
+       *  @brief  Get the publisher of the asynchronous updates, nullptr if not enabled
+       */
+      Publisher *publisher() const;
+
       /**
        *  @brief  Create a new command handler
        *
@@ -271,9 +320,23 @@ namespace dqm4hep {
       static bool commandHandlerAlreadyRunning(const std::string &name);
 
     private:
-      void handleServerInfoRequest(const Buffer &, Buffer &response);
+      /**
+       *  @brief  Check that none of the registered services, request handlers (and their async rpc)
+       *          and command handlers is already running on the network, with one dns query per top
+       *          level name prefix. Throw on duplicates
+       */
+      void checkNetworkDuplicates() const;
+
+      /**
+       *  @brief  Drop the cached server info answers, to be rebuilt on next request.
+       *          Must be called with the server info mutex locked
+       */
+      void invalidateServerInfo();
+
+      void handleServerInfoRequest(const Buffer &request, Buffer &response);
       RequestHandler *requestHandler(const std::string &name) const;
       CommandHandler *commandHandler(const std::string &name) const;
+      WorkerPool *requestWorkerPool();
       void clientExitHandler() override;
       void commandHandler() override {};
 
@@ -289,6 +352,13 @@ namespace dqm4hep {
       CommandHandlerMap             m_commandHandlerMap = {};  ///< The map of registered command handlers
       RequestHandler               *m_serverInfoHandler = {nullptr};  ///< The built-in request handler for server info
       core::Signal<int>             m_clientExitSignal = {};   ///< The signal emitted whenever a client exits
+      core::StringMap               m_hostInfo = {};           ///< The host information, filled once
+      std::mutex                    m_serverInfoMutex = {};    ///< Protects the maps against the server info requests
+      PayloadPtr                    m_jsonServerInfo = {nullptr};    ///< The cached json server info answer
+      PayloadPtr                    m_binaryServerInfo = {nullptr};  ///< The cached binary server info answer
+      unsigned int                  m_nRequestWorkers = {4};   ///< The number of threads running the deferred request handlers
+      WorkerPool                   *m_pRequestWorkerPool = {nullptr};  ///< The pool running the deferred request handlers
+      std::atomic<Publisher *>      m_pPublisher = {nullptr};  ///< The publisher of the asynchronous updates, if enabled
     };
 
     //-------------------------------------------------------------------------------------------------
@@ -304,12 +374,18 @@ namespace dqm4hep {
         throw std::runtime_error("Server::createRequestHandler(): request handler '" + rname +
                                  "' already exists in this client");
 
-      if (Server::requestHandlerAlreadyRunning(rname))
+      // before start(), checked all at once by checkNetworkDuplicates()
+      if (this->isRunning() && Server::requestHandlerAlreadyRunning(rname))
         throw std::runtime_error("Server::createRequestHandler(): request handler '" + rname +
                                  "' already running on network");
 
       // first insert nullptr, then create request handler
-      auto inserted = m_requestHandlerMap.insert(RequestHandlerMap::value_type(rname, nullptr));
+      std::pair<RequestHandlerMap::iterator, bool> inserted;
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        inserted = m_requestHandlerMap.insert(RequestHandlerMap::value_type(rname, nullptr));
+        this->invalidateServerInfo();
+      }
 
       if (inserted.second) {
         RequestHandler *pRequestHandler = new RequestHandler(this, rname, pController, function);
@@ -323,6 +399,42 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    template <typename Controller>
+    inline void Server::createRequestHandler(const std::string &rname, Controller *pController,
+                                             void (Controller::*function)(const Buffer &request, ResponsePtr response),
+                                             unsigned int maxConcurrency) {
+      auto findIter = m_requestHandlerMap.find(rname);
+
+      if (findIter != m_requestHandlerMap.end())
+        throw std::runtime_error("Server::createRequestHandler(): request handler '" + rname +
+                                 "' already exists in this client");
+
+      // before start(), checked all at once by checkNetworkDuplicates()
+      if (this->isRunning() && Server::requestHandlerAlreadyRunning(rname))
+        throw std::runtime_error("Server::createRequestHandler(): request handler '" + rname +
+                                 "' already running on network");
+
+      // first insert nullptr, then create request handler
+      std::pair<RequestHandlerMap::iterator, bool> inserted;
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        inserted = m_requestHandlerMap.insert(RequestHandlerMap::value_type(rname, nullptr));
+        this->invalidateServerInfo();
+      }
+
+      if (inserted.second) {
+        RequestHandler *pRequestHandler =
+            new RequestHandler(this, rname, pController, function, this->requestWorkerPool(), maxConcurrency);
+        inserted.first->second = pRequestHandler;
+
+        if (this->isRunning())
+          pRequestHandler->startHandlingRequest();
+      } else
+        throw;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     template <typename Controller>
     inline void Server::createCommandHandler(const std::string &cname, Controller *pController,
                                              void (Controller::*function)(const Buffer &command)) {
@@ -337,12 +449,18 @@ namespace dqm4hep {
         return;
       }
 
-      if (Server::commandHandlerAlreadyRunning(cname))
+      // before start(), checked all at once by checkNetworkDuplicates()
+      if (this->isRunning() && Server::commandHandlerAlreadyRunning(cname))
         throw std::runtime_error("Server::createCommandHandler(): command handler '" + cname +
                                  "' already running on network");
 
       // first insert nullptr, then create command handler
-      auto inserted = m_commandHandlerMap.insert(CommandHandlerMap::value_type(cname, nullptr));
+      std::pair<CommandHandlerMap::iterator, bool> inserted;
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        inserted = m_commandHandlerMap.insert(CommandHandlerMap::value_type(cname, nullptr));
+        this->invalidateServerInfo();
+      }
 
       if (inserted.second) {
         CommandHandler *pCommandHandler = new CommandHandler(this, cname, pController, function);
@@ -363,8 +481,11 @@ namespace dqm4hep {
       if (findIter != m_commandHandlerMap.end()) {
         findIter->second->onCommand().disconnect(pController);
 
-        if (!findIter->second->onCommand().hasConnection())
+        if (!findIter->second->onCommand().hasConnection()) {
+          std::lock_guard<std::mutex> lock(m_serverInfoMutex);
           m_commandHandlerMap.erase(findIter);
+          this->invalidateServerInfo();
+        }
       }
     }
 
@@ -378,8 +499,11 @@ namespace dqm4hep {
       if (findIter != m_commandHandlerMap.end()) {
         findIter->second->onCommand().disconnect(pController, function);
 
-        if (!findIter->second->onCommand().hasConnection())
+        if (!findIter->second->onCommand().hasConnection()) {
+          std::lock_guard<std::mutex> lock(m_serverInfoMutex);
           m_commandHandlerMap.erase(findIter);
+          this->invalidateServerInfo();
+        }
       }
     }
 
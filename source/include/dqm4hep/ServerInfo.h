@@ -0,0 +1,90 @@
+/// \file ServerInfo.h
+/*
+ *
+ * ServerInfo.h header template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+#ifndef SERVERINFO_H
+#define SERVERINFO_H
+
+// -- dqm4hep headers
+#include "dqm4hep/Internal.h"
+#include "dqm4hep/json.h"
+
+// -- std headers
+#include <cstdint>
+#include <string>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    /**
+     *  @brief  ServerInfo struct.
+     *          The description of a server as answered on /<server>/info.
+     *          The answer is json by default, or a compact binary encoding if
+     *          the request contents is ServerInfo::binaryRequest.
+     *
+     *  Binary layout (host byte order) : uint32 version, name, host info
+     *  as uint32 count + key/value pairs, then services, request handlers
+     *  and command handlers as uint32 count + names. Each string is stored
+     *  as uint32 length + characters.
+     */
+    struct ServerInfo {
+      static const std::string    binaryRequest;         ///< The request contents asking for the binary encoding
+      static const uint32_t       binaryVersion;         ///< The current binary encoding version
+
+      std::string                 name = {""};           ///< The short server name
+      core::StringMap             hostInfo = {};         ///< The host information
+      core::StringVector          services = {};         ///< The service names
+      core::StringVector          requestHandlers = {};  ///< The request handler names
+      core::StringVector          commandHandlers = {};  ///< The command handler names
+
+      /**
+       *  @brief  Convert to json
+       *
+       *  @param  value the json value to receive the server info
+       */
+      void toJson(core::json &value) const;
+
+      /**
+       *  @brief  Encode in the compact binary format
+       *
+       *  @param  buffer the string to receive the encoded server info
+       */
+      void encode(std::string &buffer) const;
+
+      /**
+       *  @brief  Decode from the compact binary format.
+       *          Return false if the buffer is malformed
+       *
+       *  @param  buffer the encoded buffer address
+       *  @param  size the encoded buffer size
+       */
+      bool decode(const char *buffer, size_t size);
+    };
+  }
+}
+
+#endif //  SERVERINFO_H
@@ -46,6 +46,7 @@ namespace dqm4hep {
 
     class Service {
       friend class Server;
+      friend class Publisher;
 
     public:
       /**
@@ -109,6 +110,33 @@ namespace dqm4hep {
        */
       void sendBuffer(const void *ptr, size_t size, const std::vector<int> &clientIds);
 
+      /**
+       * Send a buffer. A segmented buffer is sent without concatenating its segments
+       */
+      void sendBuffer(const Buffer &buffer);
+
+      /**
+       * Send a buffer to a specific client. A segmented buffer is sent without concatenating its segments
+       */
+      void sendBuffer(const Buffer &buffer, int clientId);
+
+      /**
+       * Send a buffer to a specific list of clients. A segmented buffer is sent without concatenating its segments
+       */
+      void sendBuffer(const Buffer &buffer, const std::vector<int> &clientIds);
+
+      /**
+       * Send a buffer, taking over its contents (model, payload or adopted memory).
+       * With asynchronous publishing the contents is queued without copy. Dim still
+       * copies it in its packets
+       */
+      void sendBuffer(Buffer &&buffer);
+
+      /**
+       * Send a buffer to a specific list of clients, taking over its contents
+       */
+      void sendBuffer(Buffer &&buffer, const std::vector<int> &clientIds);
+
     private:
       /**
        * Constructor with service name
@@ -141,10 +169,21 @@ namespace dqm4hep {
       bool isServiceConnected() const;
 
       /**
-       *
+       * Send the buffer, or queue a copy of it if the server publishes asynchronously
        */
       void sendData(const Buffer &buffer, const std::vector<int> &clientIds);
 
+      /**
+       * Write the buffer to the clients, in the calling thread
+       */
+      void writeData(const Buffer &buffer, const std::vector<int> &clientIds);
+
+      /**
+       * Send a list of segments, gathered by dim. Falls back to a concatenated
+       * copy if dim can not gather them
+       */
+      void sendSegments(DIS_SEGMENT *segments, int nSegments, const std::vector<int> &clientIds);
+
     private:
       DimService         *m_pService = {nullptr};      ///< The service implementation
       std::string         m_name = {""};               ///< The service name
@@ -157,9 +196,7 @@ namespace dqm4hep {
     template <typename T>
     inline void Service::send(const T &value) {
       Buffer buffer;
-      auto model = buffer.createModel<T>();
-      model->copy(value);
-      buffer.setModel(model);
+      buffer.copy(value);
       this->sendData(buffer, std::vector<int>());
     }
 
@@ -167,7 +204,8 @@ namespace dqm4hep {
 
     template <typename T>
     inline void Service::sendArray(const T *value, size_t nElements) {
-      Buffer buffer(value, nElements);
+      Buffer buffer;
+      buffer.adopt((const char *)value, nElements * sizeof(T));
       this->sendData(buffer, std::vector<int>());
     }
 
@@ -175,7 +213,8 @@ namespace dqm4hep {
 
     template <typename T>
     inline void Service::send(const T &value, int clientId) {
-      Buffer buffer(value);
+      Buffer buffer;
+      buffer.copy(value);
       this->sendData(buffer, std::vector<int>(1, clientId));
     }
 
@@ -183,7 +222,8 @@ namespace dqm4hep {
 
     template <typename T>
     inline void Service::sendArray(const T *value, size_t nElements, int clientId) {
-      Buffer buffer(value, nElements);
+      Buffer buffer;
+      buffer.adopt((const char *)value, nElements * sizeof(T));
       this->sendData(buffer, std::vector<int>(1, clientId));
     }
 
@@ -191,7 +231,8 @@ namespace dqm4hep {
 
     template <typename T>
     inline void Service::send(const T &value, const std::vector<int> &clientIds) {
-      Buffer buffer(value);
+      Buffer buffer;
+      buffer.copy(value);
       this->sendData(buffer, clientIds);
     }
 
@@ -199,7 +240,8 @@ namespace dqm4hep {
 
     template <typename T>
     inline void Service::sendArray(const T *value, size_t nElements, const std::vector<int> &clientIds) {
-      Buffer buffer(value, nElements);
+      Buffer buffer;
+      buffer.adopt((const char *)value, nElements * sizeof(T));
       this->sendData(buffer, clientIds);
     }
   }
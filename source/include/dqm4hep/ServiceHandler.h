@@ -49,6 +49,11 @@ namespace dqm4hep {
       friend class Client;
 
     public:
+      /**
+       *  The buffer views the dim receive buffer, valid during the signal only.
+       *  Slots keeping the contents call Buffer::payload(): the first one copies
+       *  it once, the next ones share the same payload
+       */
       typedef core::Signal<const Buffer &> UpdateSignal;
 
       /**
@@ -0,0 +1,94 @@
+/// \file WorkerPool.h
+/*
+ *
+ * WorkerPool.h header template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+// -- std headers
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    /**
+     *  @brief  WorkerPool class.
+     *          A fixed set of threads running posted tasks in FIFO order.
+     *          Used to run request handlers outside of the dim threads
+     */
+    class WorkerPool {
+    public:
+      typedef std::function<void()> Task;
+
+      /**
+       *  @brief  Constructor. Start the worker threads
+       *
+       *  @param  nWorkers the number of worker threads (at least 1)
+       */
+      WorkerPool(unsigned int nWorkers);
+      WorkerPool(const WorkerPool &) = delete;
+      WorkerPool &operator=(const WorkerPool &) = delete;
+
+      /**
+       *  @brief  Destructor. Discard the queued tasks and join the workers
+       */
+      ~WorkerPool();
+
+      /**
+       *  @brief  Post a task to run on one of the workers
+       *
+       *  @param  task the task to run
+       */
+      void post(Task task);
+
+      /**
+       *  @brief  Get the number of worker threads
+       */
+      unsigned int nWorkers() const;
+
+    private:
+      /**
+       *  @brief  The worker thread loop
+       */
+      void run();
+
+    private:
+      std::vector<std::thread>  m_workers = {};   ///< The worker threads
+      std::deque<Task>          m_tasks = {};     ///< The tasks waiting for a worker
+      std::mutex                m_mutex = {};     ///< Protects the task queue
+      std::condition_variable   m_condition = {}; ///< Signaled on new task or stop
+      bool                      m_stop = {false}; ///< Whether the workers have to exit
+    };
+  }
+}
+
+#endif //  WORKERPOOL_H
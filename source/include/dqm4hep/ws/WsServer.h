@@ -3,6 +3,7 @@
 
 // -- boost headers
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/spawn.hpp>
 #include <boost/functional/hash.hpp>
@@ -10,8 +11,11 @@
 // -- std headers
 #include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -28,6 +32,8 @@
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 
+#include <zlib.h>
+
 #ifndef CASE_INSENSITIVE_EQUALS_AND_HASH
 #define CASE_INSENSITIVE_EQUALS_AND_HASH
 // Based on http://www.boost.org/doc/libs/1_60_0/doc/html/unordered/hash_equality.html
@@ -317,6 +323,155 @@ namespace dqm4hep {
         }
       };
 
+      /// Unmask a client payload, given as the 4 bytes masking key followed by length bytes.
+      /// The unmasked payload is written over the key, starting at data, one 8 bytes word at a time
+      static void unmask_payload(unsigned char *data, size_t length) {
+        unsigned char mask[8];
+        std::memcpy(mask, data, 4);
+        std::memcpy(mask + 4, data, 4);
+        std::uint64_t mask_word;
+        std::memcpy(&mask_word, mask, 8);
+
+        // Each word is loaded before the (overlapping) store, 4 bytes behind the next load
+        const unsigned char *masked = data + 4;
+        size_t c = 0;
+        for (; c + 8 <= length; c += 8) {
+          std::uint64_t word;
+          std::memcpy(&word, masked + c, 8);
+          word ^= mask_word;
+          std::memcpy(data + c, &word, 8);
+        }
+        for (; c < length; c++)
+          data[c] = masked[c] ^ mask[c % 4];
+      }
+
+      /// Compress a message payload for permessage-deflate (RFC 7692), without context takeover: the
+      /// output does not depend on the previous messages. Returns false if the payload does not shrink
+      static bool deflate_payload(const std::vector<boost::asio::const_buffer> &payload, int window_bits,
+                                  std::string &out) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+          return false;
+
+        size_t length = boost::asio::buffer_size(payload);
+        // room for the sync flush marker
+        out.resize(deflateBound(&stream, length) + 16);
+        stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+
+        int ret = Z_OK;
+        for (auto &part : payload) {
+          stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(boost::asio::buffer_cast<const char *>(part)));
+          stream.avail_in = static_cast<uInt>(boost::asio::buffer_size(part));
+          if (stream.avail_in == 0)
+            continue;
+          if ((ret = deflate(&stream, Z_NO_FLUSH)) != Z_OK)
+            break;
+        }
+        if (ret == Z_OK)
+          ret = deflate(&stream, Z_SYNC_FLUSH);
+
+        size_t produced = out.size() - stream.avail_out;
+        bool full = (stream.avail_out == 0);
+        deflateEnd(&stream);
+
+        // the 00 00 ff ff ending the sync flush is not sent (RFC 7692 section 7.2.1)
+        if (ret != Z_OK || full || produced < 4 || produced - 4 >= length)
+          return false;
+        out.resize(produced - 4);
+        return true;
+      }
+
+      /// Encode a websocket frame header, unmasked. Returns the header size (at most 10 bytes)
+      static size_t encode_header(unsigned char *header, size_t length, unsigned char fin_rsv_opcode) {
+        size_t header_size = 0;
+
+        header[header_size++] = fin_rsv_opcode;
+        // unmasked (first length byte<128)
+        if (length >= 126) {
+          int num_bytes;
+          if (length > 0xffff) {
+            num_bytes = 8;
+            header[header_size++] = 127;
+          } else {
+            num_bytes = 2;
+            header[header_size++] = 126;
+          }
+
+          for (int c = num_bytes - 1; c >= 0; c--) {
+            header[header_size++] = (static_cast<unsigned long long>(length) >> (8 * c)) % 256;
+          }
+        } else
+          header[header_size++] = static_cast<unsigned char>(length);
+
+        return header_size;
+      }
+
+      /// A complete websocket frame (header and payload), encoded once and immutable.
+      /// The same frame can be queued on any number of connections, it is never consumed.
+      /// A frame with a conflation key replaces the frame with the same key still waiting
+      /// in a connection send queue, if any (e.g the previous update of the same service)
+      class SharedFrame {
+      public:
+        /// Encode the frame of the concatenation of the payload parts
+        SharedFrame(const std::vector<boost::asio::const_buffer> &payload, unsigned char fin_rsv_opcode = 129,
+                    const std::string &conflation_key = std::string())
+            : fin_rsv_opcode(fin_rsv_opcode), conflation_key(conflation_key) {
+          size_t length = boost::asio::buffer_size(payload);
+          unsigned char header[10];
+          header_size = encode_header(header, length, fin_rsv_opcode);
+
+          data.reserve(header_size + length);
+          data.append(reinterpret_cast<const char *>(header), header_size);
+
+          for (auto &part : payload)
+            data.append(boost::asio::buffer_cast<const char *>(part), boost::asio::buffer_size(part));
+        }
+        SharedFrame(const SharedFrame &) = delete;
+        SharedFrame &operator=(const SharedFrame &) = delete;
+
+        const unsigned char fin_rsv_opcode;
+        const std::string conflation_key;
+
+        boost::asio::const_buffers_1 buffer() const {
+          return boost::asio::buffer(data);
+        }
+        size_t size() const {
+          return data.size();
+        }
+
+        /// The permessage-deflate variant of a data frame for the given window bits (9 to 15). It is compressed
+        /// on first use and shared by all the connections that negotiated the same window, the server never
+        /// uses context takeover. Null if the payload is smaller than min_size or does not shrink
+        std::shared_ptr<const SharedFrame> deflated(int window_bits, size_t min_size) const {
+          unsigned char opcode = fin_rsv_opcode & 0x0f;
+          if ((opcode != 1 && opcode != 2) || (fin_rsv_opcode & 0x40) || data.size() - header_size < min_size)
+            return nullptr;
+
+          std::lock_guard<std::mutex> lock(deflate_mutex);
+          int index = std::min(std::max(window_bits, 9), 15) - 9;
+          if (!deflate_done[index]) {
+            deflate_done[index] = true;
+            std::string payload;
+            if (deflate_payload({boost::asio::buffer(data.data() + header_size, data.size() - header_size)},
+                                index + 9, payload))
+              deflated_frames[index] = std::make_shared<const SharedFrame>(
+                  std::vector<boost::asio::const_buffer>{boost::asio::buffer(payload)}, fin_rsv_opcode | 0x40,
+                  conflation_key);
+          }
+          return deflated_frames[index];
+        }
+
+      private:
+        std::string data;
+        size_t header_size;
+
+        mutable std::mutex deflate_mutex;
+        mutable std::shared_ptr<const SharedFrame> deflated_frames[7];
+        mutable bool deflate_done[7] = {};
+      };
+
       class Connection {
         friend class SocketServerBase<socket_type>;
         friend class SocketServer<socket_type>;
@@ -335,6 +490,27 @@ namespace dqm4hep {
         std::string remote_endpoint_address;
         unsigned short remote_endpoint_port;
 
+        /// Number of forwarded frames waiting in the send queue
+        size_t queued_messages() const {
+          return n_queued_messages;
+        }
+        /// Size in bytes of the forwarded frames waiting in the send queue
+        size_t queued_bytes() const {
+          return n_queued_bytes;
+        }
+        /// Number of forwarded frames dropped because the send queue was full
+        size_t dropped_messages() const {
+          return n_dropped_messages;
+        }
+        /// Number of forwarded frames replaced in the send queue by a newer one with the same conflation key
+        size_t conflated_messages() const {
+          return n_conflated_messages;
+        }
+        /// Whether the permessage-deflate extension was negotiated with the client
+        bool permessage_deflate() const {
+          return deflate_window_bits > 0;
+        }
+
       private:
         Connection(socket_type *socket) : socket(socket), strand(socket->get_io_service()), closed(false) {
         }
@@ -345,8 +521,13 @@ namespace dqm4hep {
                    const std::function<void(const boost::system::error_code)> &callback)
               : header_stream(header_stream), message_stream(message_stream), callback(callback) {
           }
+          SendData(const std::shared_ptr<const SharedFrame> &frame,
+                   const std::function<void(const boost::system::error_code)> &callback)
+              : frame(frame), callback(callback) {
+          }
           std::shared_ptr<SendStream> header_stream;
           std::shared_ptr<SendStream> message_stream;
+          std::shared_ptr<const SharedFrame> frame;
           std::function<void(const boost::system::error_code)> callback;
         };
 
@@ -356,8 +537,78 @@ namespace dqm4hep {
 
         std::list<SendData> send_queue;
 
+        std::atomic<size_t> n_queued_messages{0};
+        std::atomic<size_t> n_queued_bytes{0};
+        std::atomic<size_t> n_dropped_messages{0};
+        std::atomic<size_t> n_conflated_messages{0};
+
+        /// Window bits of the messages compressed for the client, 0 if permessage-deflate is not negotiated
+        int deflate_window_bits = 0;
+        /// Decompression of the client messages, kept from one message to the next (client context takeover)
+        std::shared_ptr<z_stream> inflate_stream;
+
+        /// Queue a forwarded frame, in the strand. The front of the queue is being written, the
+        /// frames waiting behind it are conflated or dropped (oldest first) to stay within the limits.
+        /// A frame bigger than the limit is still queued once the waiting frames are dropped
+        void queue_frame(const std::shared_ptr<Connection> &connection, const std::shared_ptr<const SharedFrame> &frame,
+                         const std::function<void(const boost::system::error_code)> &callback, size_t max_messages,
+                         size_t max_bytes) {
+          if (send_queue.empty()) {
+            send_queue.emplace_back(frame, callback);
+            send_from_queue(connection);
+            return;
+          }
+
+          auto waiting = std::next(send_queue.begin());
+
+          if (!frame->conflation_key.empty()) {
+            for (auto iter = waiting; iter != send_queue.end(); ++iter) {
+              if (iter->frame && iter->frame->conflation_key == frame->conflation_key) {
+                n_queued_bytes -= iter->frame->size();
+                n_queued_bytes += frame->size();
+                ++n_conflated_messages;
+                if (iter->callback)
+                  iter->callback(boost::asio::error::operation_aborted);
+                iter->frame = frame;
+                iter->callback = callback;
+                return;
+              }
+            }
+          }
+
+          for (auto iter = waiting; iter != send_queue.end() &&
+                                    ((max_messages > 0 && n_queued_messages >= max_messages) ||
+                                     (max_bytes > 0 && n_queued_bytes + frame->size() > max_bytes));) {
+            // never drop a close frame
+            if (!iter->frame || iter->frame->fin_rsv_opcode == 136) {
+              ++iter;
+              continue;
+            }
+            --n_queued_messages;
+            n_queued_bytes -= iter->frame->size();
+            ++n_dropped_messages;
+            if (iter->callback)
+              iter->callback(boost::asio::error::operation_aborted);
+            iter = send_queue.erase(iter);
+          }
+
+          send_queue.emplace_back(frame, callback);
+          ++n_queued_messages;
+          n_queued_bytes += frame->size();
+        }
+
         void send_from_queue(const std::shared_ptr<Connection> &connection) {
           strand.post([this, connection]() {
+            if (send_queue.begin()->frame) {
+              // written from the shared frame in one go, without consuming it
+              boost::asio::async_write(
+                  *socket, send_queue.begin()->frame->buffer(),
+                  strand.wrap([this, connection](const boost::system::error_code &ec, size_t /*bytes_transferred*/) {
+                    send_done(connection, ec);
+                  }));
+              return;
+            }
+
             boost::asio::async_write(
                 *socket, send_queue.begin()->header_stream->streambuf,
                 strand.wrap([this, connection](const boost::system::error_code &ec, size_t /*bytes_transferred*/) {
@@ -365,26 +616,35 @@ namespace dqm4hep {
                     boost::asio::async_write(*socket, send_queue.begin()->message_stream->streambuf,
                                              strand.wrap([this, connection](const boost::system::error_code &ec,
                                                                             size_t /*bytes_transferred*/) {
-                                               auto send_queued = send_queue.begin();
-                                               if (send_queued->callback)
-                                                 send_queued->callback(ec);
-                                               if (!ec) {
-                                                 send_queue.erase(send_queued);
-                                                 if (send_queue.size() > 0)
-                                                   send_from_queue(connection);
-                                               } else
-                                                 send_queue.clear();
+                                               send_done(connection, ec);
                                              }));
-                  } else {
-                    auto send_queued = send_queue.begin();
-                    if (send_queued->callback)
-                      send_queued->callback(ec);
-                    send_queue.clear();
-                  }
+                  } else
+                    send_done(connection, ec);
                 }));
           });
         }
 
+        void send_done(const std::shared_ptr<Connection> &connection, const boost::system::error_code &ec) {
+          auto send_queued = send_queue.begin();
+          if (send_queued->callback)
+            send_queued->callback(ec);
+          if (!ec) {
+            send_queue.erase(send_queued);
+            if (send_queue.size() > 0) {
+              // the next frame is not waiting anymore
+              if (send_queue.begin()->frame) {
+                --n_queued_messages;
+                n_queued_bytes -= send_queue.begin()->frame->size();
+              }
+              send_from_queue(connection);
+            }
+          } else {
+            send_queue.clear();
+            n_queued_messages = 0;
+            n_queued_bytes = 0;
+          }
+        }
+
         std::atomic<bool> closed;
 
         std::unique_ptr<boost::asio::deadline_timer> timer_idle;
@@ -436,6 +696,10 @@ namespace dqm4hep {
         streambuffer *buffer() {
           return &streambuf;
         }
+        /// View over the unmasked message bytes, valid as long as the message
+        const char *data() {
+          return streambuf.begin_iptr();
+        }
 
       private:
         Message() : std::istream(&streambuf) {
@@ -489,6 +753,18 @@ namespace dqm4hep {
         std::string address;
         /// Set to false to avoid binding the socket to an address that is already in use. Defaults to true.
         bool reuse_address = true;
+        /// Maximum number of forwarded frames waiting in a connection send queue. Defaults to no limit.
+        size_t max_queued_messages = 0;
+        /// Maximum size in bytes of the forwarded frames waiting in a connection send queue. Defaults to no limit.
+        size_t max_queued_bytes = 0;
+        /// Maximum size in bytes of a received message, a bigger one closes the connection. Defaults to 64 MiB.
+        size_t max_message_size = 64 * 1024 * 1024;
+        /// Accept the permessage-deflate extension (RFC 7692) offered by the clients. Defaults to false.
+        bool permessage_deflate = false;
+        /// Maximum window bits (9 to 15) of the messages compressed for the clients. Defaults to 15.
+        int deflate_window_bits = 15;
+        /// Messages smaller than this size in bytes are sent uncompressed. Defaults to 1024 bytes.
+        size_t deflate_min_size = 1024;
       };
 
       /// Set before calling start().
@@ -574,25 +850,9 @@ namespace dqm4hep {
                                                 unsigned char fin_rsv_opcode) const {
         auto header_stream = std::make_shared<SendStream>();
 
-        size_t length = message_stream->size();
-
-        header_stream->put(fin_rsv_opcode);
-        // unmasked (first length byte<128)
-        if (length >= 126) {
-          int num_bytes;
-          if (length > 0xffff) {
-            num_bytes = 8;
-            header_stream->put(127);
-          } else {
-            num_bytes = 2;
-            header_stream->put(126);
-          }
-
-          for (int c = num_bytes - 1; c >= 0; c--) {
-            header_stream->put((static_cast<unsigned long long>(length) >> (8 * c)) % 256);
-          }
-        } else
-          header_stream->put(static_cast<unsigned char>(length));
+        unsigned char header[10];
+        size_t header_size = encode_header(header, message_stream->size(), fin_rsv_opcode);
+        header_stream->write(reinterpret_cast<const char *>(header), header_size);
 
         return header_stream;
       }
@@ -601,16 +861,30 @@ namespace dqm4hep {
                    const std::shared_ptr<SendStream> &message_stream,
                    const std::function<void(const boost::system::error_code &)> &callback = nullptr,
                    unsigned char fin_rsv_opcode = 129) const {
-        auto header_stream = prepareHeader(message_stream, fin_rsv_opcode);
+        // encoded once in a shared frame: a stream buffer is consumed by the first write
+        auto frame = std::make_shared<const SharedFrame>(
+            std::vector<boost::asio::const_buffer>{message_stream->streambuf.data()}, fin_rsv_opcode);
+        forward(connections, frame, callback);
+      }
 
-        for (auto connection : connections) {
-          if (fin_rsv_opcode != 136)
+      /// Queue the same encoded frame on every connection, without copying it.
+      /// The connection send queues are bounded by config.max_queued_messages and config.max_queued_bytes
+      void forward(const std::unordered_set<std::shared_ptr<Connection>> &connections,
+                   const std::shared_ptr<const SharedFrame> &frame,
+                   const std::function<void(const boost::system::error_code &)> &callback = nullptr) const {
+        size_t max_messages = config.max_queued_messages;
+        size_t max_bytes = config.max_queued_bytes;
+        size_t deflate_min_size = config.deflate_min_size;
+
+        for (auto &connection : connections) {
+          if (frame->fin_rsv_opcode != 136)
             timer_idle_reset(connection);
 
-          connection->strand.post([this, connection, header_stream, message_stream, callback]() {
-            connection->send_queue.emplace_back(header_stream, message_stream, callback);
-            if (connection->send_queue.size() == 1)
-              connection->send_from_queue(connection);
+          connection->strand.post([connection, frame, callback, max_messages, max_bytes, deflate_min_size]() {
+            std::shared_ptr<const SharedFrame> deflated;
+            if (connection->deflate_window_bits > 0)
+              deflated = frame->deflated(connection->deflate_window_bits, deflate_min_size);
+            connection->queue_frame(connection, deflated ? deflated : frame, callback, max_messages, max_bytes);
           });
         }
       }
@@ -624,10 +898,22 @@ namespace dqm4hep {
         if (fin_rsv_opcode != 136)
           timer_idle_reset(connection);
 
-        auto header_stream = prepareHeader(message_stream, fin_rsv_opcode);
+        auto sent_stream = message_stream;
+        unsigned char opcode = fin_rsv_opcode & 0x0f;
+        if (connection->deflate_window_bits > 0 && (opcode == 1 || opcode == 2) &&
+            message_stream->size() >= config.deflate_min_size) {
+          std::string payload;
+          if (deflate_payload({message_stream->streambuf.data()}, connection->deflate_window_bits, payload)) {
+            sent_stream = std::make_shared<SendStream>();
+            sent_stream->write(payload.data(), payload.size());
+            fin_rsv_opcode |= 0x40;
+          }
+        }
+
+        auto header_stream = prepareHeader(sent_stream, fin_rsv_opcode);
 
-        connection->strand.post([this, connection, header_stream, message_stream, callback]() {
-          connection->send_queue.emplace_back(header_stream, message_stream, callback);
+        connection->strand.post([this, connection, header_stream, sent_stream, callback]() {
+          connection->send_queue.emplace_back(header_stream, sent_stream, callback);
           if (connection->send_queue.size() == 1)
             connection->send_from_queue(connection);
         });
@@ -811,11 +1097,121 @@ namespace dqm4hep {
         handshake << "Upgrade: websocket\r\n";
         handshake << "Connection: Upgrade\r\n";
         handshake << "Sec-WebSocket-Accept: " << Crypto::Base64::encode(sha1) << "\r\n";
+        if (config.permessage_deflate) {
+          auto extension = negotiate_deflate(connection);
+          if (!extension.empty())
+            handshake << "Sec-WebSocket-Extensions: " << extension << "\r\n";
+        }
         handshake << "\r\n";
 
         return true;
       }
 
+      /// Accept the first permessage-deflate offer of the client that fits the configuration. The server always
+      /// compresses without context takeover, so that a forwarded frame is compressed once for all the connections.
+      /// Returns the extension response, empty if no offer is accepted
+      std::string negotiate_deflate(const std::shared_ptr<Connection> &connection) const {
+        int max_window_bits = std::min(std::max(config.deflate_window_bits, 9), 15);
+        auto offers = connection->header.equal_range("Sec-WebSocket-Extensions");
+
+        for (auto header_it = offers.first; header_it != offers.second; ++header_it) {
+          std::stringstream offers_stream(header_it->second);
+          std::string offer;
+          while (getline(offers_stream, offer, ',')) {
+            std::stringstream offer_stream(offer);
+            std::string param;
+            getline(offer_stream, param, ';');
+            if (boost::algorithm::trim_copy(param) != "permessage-deflate")
+              continue;
+
+            int window_bits = max_window_bits;
+            bool window_bits_offered = false, accepted = true;
+            while (accepted && getline(offer_stream, param, ';')) {
+              size_t equal = param.find('=');
+              std::string name = boost::algorithm::trim_copy(param.substr(0, equal));
+              std::string value =
+                  equal == std::string::npos ? "" : boost::algorithm::trim_copy(param.substr(equal + 1));
+              if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                value = value.substr(1, value.size() - 2);
+
+              if (name == "server_no_context_takeover" || name == "client_no_context_takeover" ||
+                  name == "client_max_window_bits") {
+                // client messages are inflated with the largest window, kept from one message to the next
+              } else if (name == "server_max_window_bits") {
+                // zlib raw deflate does not support a 8 bits window
+                int bits = atoi(value.c_str());
+                accepted = (bits >= 9 && bits <= 15);
+                window_bits = std::min(window_bits, bits);
+                window_bits_offered = true;
+              } else
+                accepted = false;
+            }
+            if (!accepted)
+              continue;
+
+            connection->deflate_window_bits = window_bits;
+            std::string extension = "permessage-deflate; server_no_context_takeover";
+            if (window_bits_offered || window_bits < 15)
+              extension += "; server_max_window_bits=" + std::to_string(window_bits);
+            return extension;
+          }
+        }
+        return std::string();
+      }
+
+      /// Inflate a permessage-deflate payload into message, up to config.max_message_size bytes. The payload must be
+      /// followed by 4 writable bytes, where the end of the sync flush removed by the client is restored.
+      /// Returns 0, or the status to close the connection with: 1009 if too big, 1002 if invalid
+      int inflate_payload(const std::shared_ptr<Connection> &connection, unsigned char *payload, size_t length,
+                          Message &message) const {
+        const size_t max_chunk = std::numeric_limits<uInt>::max();
+        if (length > max_chunk - 4)
+          return 1009;
+
+        if (!connection->inflate_stream) {
+          connection->inflate_stream = std::shared_ptr<z_stream>(new z_stream(), [](z_stream *stream) {
+            inflateEnd(stream);
+            delete stream;
+          });
+          if (inflateInit2(connection->inflate_stream.get(), -15) != Z_OK)
+            return 1002;
+        }
+
+        static const unsigned char flush_marker[4] = {0x00, 0x00, 0xff, 0xff};
+        std::memcpy(payload + length, flush_marker, 4);
+
+        z_stream *stream = connection->inflate_stream.get();
+        stream->next_in = payload;
+        stream->avail_in = static_cast<uInt>(length + 4);
+
+        int ret;
+        do {
+          // at most one byte over the limit, to detect a message that exceeds it
+          size_t remaining = config.max_message_size - message.streambuf.size();
+          size_t chunk = std::max<size_t>(4 * std::min(length, max_chunk / 4), 4096);
+          if (remaining < chunk)
+            chunk = remaining + 1;
+
+          auto out = boost::asio::buffer(message.streambuf.prepare(chunk));
+          stream->next_out = boost::asio::buffer_cast<Bytef *>(out);
+          stream->avail_out = static_cast<uInt>(boost::asio::buffer_size(out));
+          ret = inflate(stream, Z_SYNC_FLUSH);
+          message.streambuf.commit(boost::asio::buffer_size(out) - stream->avail_out);
+
+          if (message.streambuf.size() > config.max_message_size)
+            return 1009;
+        } while (ret == Z_OK && stream->avail_out == 0);
+
+        // a final deflate block ends the client context
+        if (ret == Z_STREAM_END)
+          inflateReset(stream);
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+          return 1002;
+
+        message.length = message.streambuf.size();
+        return 0;
+      }
+
       void read_message(const std::shared_ptr<Connection> &connection,
                         const std::shared_ptr<boost::asio::streambuf> &read_buffer, Endpoint &endpoint) const {
         boost::asio::async_read(
@@ -878,10 +1274,20 @@ namespace dqm4hep {
                                               length_bytes.resize(8);
                                               stream.read((char *)&length_bytes[0], 8);
 
-                                              size_t length = 0;
+                                              // the most significant bit must be 0 (RFC 6455 section 5.2)
+                                              if (length_bytes[0] & 0x80) {
+                                                const std::string reason("invalid message length");
+                                                send_close(connection, 1002, reason,
+                                                           [this, connection](const boost::system::error_code &) {});
+                                                connection_close(connection, endpoint, 1002, reason);
+                                                return;
+                                              }
+
+                                              std::uint64_t length = 0;
                                               int num_bytes = 8;
                                               for (int c = 0; c < num_bytes; c++)
-                                                length += length_bytes[c] << (8 * (num_bytes - 1 - c));
+                                                length |= static_cast<std::uint64_t>(length_bytes[c])
+                                                          << (8 * (num_bytes - 1 - c));
 
                                               read_message_content(connection, read_buffer, length, endpoint,
                                                                    fin_rsv_opcode);
@@ -896,27 +1302,61 @@ namespace dqm4hep {
       }
 
       void read_message_content(const std::shared_ptr<Connection> &connection,
-                                const std::shared_ptr<boost::asio::streambuf> &read_buffer, size_t length,
+                                const std::shared_ptr<boost::asio::streambuf> &read_buffer, std::uint64_t frame_length,
                                 Endpoint &endpoint, unsigned char fin_rsv_opcode) const {
-        boost::asio::async_read(*connection->socket, *read_buffer, boost::asio::transfer_exactly(4 + length),
-                                [this, connection, read_buffer, length, &endpoint,
-                                 fin_rsv_opcode](const boost::system::error_code &ec, size_t /*bytes_transferred*/) {
-                                  if (!ec) {
-                                    std::istream raw_message_data(read_buffer.get());
-
-                                    // Read mask
-                                    std::vector<unsigned char> mask;
-                                    mask.resize(4);
-                                    raw_message_data.read((char *)&mask[0], 4);
+        // checked before any allocation: the length comes from the client, 4 + length must not wrap
+        if (frame_length > config.max_message_size || frame_length > std::numeric_limits<size_t>::max() - 4) {
+          const std::string reason("message too big");
+          send_close(connection, 1009, reason, [this, connection](const boost::system::error_code & /*ec*/) {});
+          connection_close(connection, endpoint, 1009, reason);
+          return;
+        }
+        size_t length = static_cast<size_t>(frame_length);
+
+        std::shared_ptr<Message> message(new Message());
+        message->length = length;
+        message->fin_rsv_opcode = fin_rsv_opcode;
+
+        // The mask and the payload are read straight into the message buffer and unmasked there
+        boost::asio::mutable_buffer content;
+        try {
+          content = boost::asio::buffer(message->streambuf.prepare(4 + length));
+        } catch (const std::exception &) {
+          const std::string reason("message too big");
+          send_close(connection, 1009, reason, [this, connection](const boost::system::error_code & /*ec*/) {});
+          connection_close(connection, endpoint, 1009, reason);
+          return;
+        }
 
-                                    std::shared_ptr<Message> message(new Message());
-                                    message->length = length;
-                                    message->fin_rsv_opcode = fin_rsv_opcode;
+        // Bytes already buffered after the handshake come first
+        size_t buffered = boost::asio::buffer_copy(content, read_buffer->data());
+        read_buffer->consume(buffered);
 
-                                    std::ostream message_data_out_stream(&message->streambuf);
-                                    for (size_t c = 0; c < length; c++) {
-                                      message_data_out_stream.put(raw_message_data.get() ^ mask[c % 4]);
-                                    }
+        boost::asio::async_read(*connection->socket, content + buffered,
+                                [this, connection, read_buffer, message, content, length, &endpoint, fin_rsv_opcode](
+                                    const boost::system::error_code &ec, size_t /*bytes_transferred*/) mutable {
+                                  if (!ec) {
+                                    auto payload = boost::asio::buffer_cast<unsigned char *>(content);
+                                    unmask_payload(payload, length);
+
+                                    if (fin_rsv_opcode & 0x40) {
+                                      // permessage-deflate, only on the data frames of a negotiated connection
+                                      std::shared_ptr<Message> inflated(new Message());
+                                      inflated->fin_rsv_opcode = fin_rsv_opcode & 0xbf;
+                                      int status = 1002;
+                                      if ((fin_rsv_opcode & 0x0f) < 8 && connection->deflate_window_bits > 0)
+                                        status = inflate_payload(connection, payload, length, *inflated);
+                                      if (status != 0) {
+                                        const std::string reason(status == 1009 ? "message too big"
+                                                                                : "invalid compressed message");
+                                        send_close(connection, status, reason,
+                                                   [this, connection](const boost::system::error_code & /*ec*/) {});
+                                        connection_close(connection, endpoint, status, reason);
+                                        return;
+                                      }
+                                      message = inflated;
+                                    } else
+                                      message->streambuf.commit(length);
 
                                     // If connection close
                                     if ((fin_rsv_opcode & 0x0f) == 8) {
@@ -32,12 +32,18 @@
 
 #include "json/json.h"
 
+#include <regex>
+
 using WsServer = dqm4hep::net::SocketServer<dqm4hep::net::WS>;
 using Endpoint = WsServer::Endpoint;
 using Client = dqm4hep::net::Client;
 using Buffer = dqm4hep::net::Buffer;
 
 static const size_t maxNumberStrLen = 16;
+static const size_t defaultMaxQueuedMessages = 64;
+static const size_t defaultMaxQueuedBytes = 64 * 1024 * 1024;
+static const int defaultDeflateWindowBits = 15;
+static const size_t defaultDeflateMinSize = 1024;
 
 //----------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------
@@ -69,42 +75,78 @@ void trim(std::string &str) {
 
 class ServiceForwarding {
 public:
-  ServiceForwarding(const std::string &serviceName, WsServer &server);
-  std::unordered_set<std::shared_ptr<WsServer::Connection>> &connections();
+  typedef std::unordered_set<std::shared_ptr<WsServer::Connection>> ConnectionSet;
+
+  ServiceForwarding(const std::string &serviceName, WsServer &server, bool conflate);
+  void addConnection(std::shared_ptr<WsServer::Connection> connection);
+  bool removeConnection(std::shared_ptr<WsServer::Connection> connection);
   void forward(const Buffer &contents);
 
 private:
   std::string m_serviceName;
   WsServer &m_server;
-  std::unordered_set<std::shared_ptr<WsServer::Connection>> m_connections;
+  bool m_conflate;
+  boost::asio::strand m_strand;                        // keeps the updates in order over the asio threads
+  std::mutex m_mutex;                                  // serializes the connection set updates
+  std::shared_ptr<const ConnectionSet> m_connections;  // copy on write, read without lock by forward()
 };
 
 //----------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------
 
-inline ServiceForwarding::ServiceForwarding(const std::string &serviceName, WsServer &server)
-    : m_serviceName(serviceName), m_server(server) {
+inline ServiceForwarding::ServiceForwarding(const std::string &serviceName, WsServer &server, bool conflate)
+    : m_serviceName(serviceName), m_server(server), m_conflate(conflate), m_strand(*server.io_service),
+      m_connections(std::make_shared<const ConnectionSet>()) {
   /* nop */
 }
 
 //----------------------------------------------------------------------------------
 
-std::unordered_set<std::shared_ptr<WsServer::Connection>> &ServiceForwarding::connections() {
-  return m_connections;
+void ServiceForwarding::addConnection(std::shared_ptr<WsServer::Connection> connection) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto connections = std::make_shared<ConnectionSet>(*m_connections);
+  connections->insert(connection);
+  std::atomic_store(&m_connections, std::shared_ptr<const ConnectionSet>(connections));
 }
 
 //----------------------------------------------------------------------------------
 
-void ServiceForwarding::forward(const Buffer &contents) {
-  auto connections = this->connections();
+bool ServiceForwarding::removeConnection(std::shared_ptr<WsServer::Connection> connection) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (0 == m_connections->count(connection))
+    return m_connections->empty();
+
+  auto connections = std::make_shared<ConnectionSet>(*m_connections);
+  connections->erase(connection);
+  std::atomic_store(&m_connections, std::shared_ptr<const ConnectionSet>(connections));
+  return connections->empty();
+}
 
-  auto message_stream = std::make_shared<WsServer::SendStream>();
-  *message_stream << m_serviceName;
-  *message_stream << std::string(MAX_NAME - m_serviceName.size(), ' ');
-  message_stream->write(contents.begin(), contents.size());
+//----------------------------------------------------------------------------------
 
-  // std::cout << "Sending service data. Service : " << m_serviceName << " , data : " << contents << std::endl;
-  m_server.forward(connections, message_stream);
+void ServiceForwarding::forward(const Buffer &contents) {
+  static const std::string padding(MAX_NAME, ' ');
+  auto connections = std::atomic_load(&m_connections);
+
+  if (connections->empty())
+    return;
+
+  const size_t nameSize = std::min(m_serviceName.size(), (size_t)MAX_NAME);
+
+  // the whole frame (header, padded name, contents) is encoded once per update
+  // and the same immutable frame is queued on every subscribed connection.
+  // If conflated, an update still waiting for a slow connection is replaced by this one
+  auto frame = std::make_shared<const WsServer::SharedFrame>(
+      std::vector<boost::asio::const_buffer>{boost::asio::buffer(m_serviceName.data(), nameSize),
+                                             boost::asio::buffer(padding.data(), MAX_NAME - nameSize),
+                                             boost::asio::buffer(contents.begin(), contents.size())},
+      129, m_conflate ? m_serviceName : std::string());
+
+  // handed over to the asio threads in a single post: the dim thread only encodes the frame.
+  // The connections are queued from an asio thread and written by their strands in parallel
+  WsServer &server = m_server;
+  m_strand.post([&server, connections, frame]() { server.forward(*connections, frame); });
 }
 
 //----------------------------------------------------------------------------------
@@ -112,7 +154,7 @@ void ServiceForwarding::forward(const Buffer &contents) {
 
 class ServiceManager {
 public:
-  ServiceManager(Client &client, WsServer &server, Endpoint &serviceEndpoint);
+  ServiceManager(Client &client, WsServer &server, Endpoint &serviceEndpoint, const std::string &conflationRegex);
 
   void addConnection(const std::string &serviceName, std::shared_ptr<WsServer::Connection> connection);
   void removeConnection(const std::string &serviceName, std::shared_ptr<WsServer::Connection> connection);
@@ -122,24 +164,37 @@ private:
   Client &m_client;
   WsServer &m_server;
   Endpoint &m_serviceEndpoint;
+  std::regex m_conflationRegex;
 
   typedef std::map<std::string, ServiceForwarding *> ServiceForwardingMap;
+  std::mutex m_mutex;  // the asio threads handle the (un)subscriptions concurrently
   ServiceForwardingMap m_serviceConnections;
 };
 
 //----------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------
 
-inline ServiceManager::ServiceManager(Client &client, WsServer &server, Endpoint &serviceEndpoint)
-    : m_client(client), m_server(server), m_serviceEndpoint(serviceEndpoint) {
+inline ServiceManager::ServiceManager(Client &client, WsServer &server, Endpoint &serviceEndpoint,
+                                      const std::string &conflationRegex)
+    : m_client(client), m_server(server), m_serviceEndpoint(serviceEndpoint), m_conflationRegex(conflationRegex) {
   ServiceManager &me = *this;
   m_serviceEndpoint.on_open = [](std::shared_ptr<WsServer::Connection> connection) {
-    std::cout << "New web connection" << std::endl;
+    std::cout << "New web connection" << (connection->permessage_deflate() ? " (permessage-deflate)" : "") << std::endl;
   };
 
   m_serviceEndpoint.on_close = [this](std::shared_ptr<WsServer::Connection> connection, int status,
                                       const std::string &reason) {
-    std::cout << "Removing connection. status : " << status << ", reason : " << reason << std::endl;
+    std::cout << "Removing connection. status : " << status << ", reason : " << reason
+              << ", dropped : " << connection->dropped_messages() << ", conflated : " << connection->conflated_messages()
+              << std::endl;
+
+    this->removeConnection(connection);
+  };
+
+  m_serviceEndpoint.on_error = [this](std::shared_ptr<WsServer::Connection> connection,
+                                      const boost::system::error_code &ec) {
+    std::cout << "Removing connection. error : " << ec.message() << ", dropped : " << connection->dropped_messages()
+              << ", conflated : " << connection->conflated_messages() << std::endl;
 
     this->removeConnection(connection);
   };
@@ -152,11 +207,11 @@ inline ServiceManager::ServiceManager(Client &client, WsServer &server, Endpoint
     }
 
     // Extract command name and content
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string serviceName(messageStr, 0, MAX_NAME);
+    const char *messageData = message->data();
+    std::string serviceName(messageData, MAX_NAME);
     trim(serviceName);
 
-    std::string action(messageStr, MAX_NAME);
+    std::string action(messageData + MAX_NAME, message->size() - MAX_NAME);
 
     if (action == "subscribe") {
       this->addConnection(serviceName, connection);
@@ -173,31 +228,32 @@ inline ServiceManager::ServiceManager(Client &client, WsServer &server, Endpoint
 
 inline void ServiceManager::addConnection(const std::string &serviceName,
                                           std::shared_ptr<WsServer::Connection> connection) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   auto iter = m_serviceConnections.find(serviceName);
 
   // no subscription for this service yet
   // subscribe to service !
   if (m_serviceConnections.end() == iter) {
-    ServiceForwarding *srvFwd = new ServiceForwarding(serviceName, m_server);
+    bool conflate = std::regex_match(serviceName, m_conflationRegex);
+    ServiceForwarding *srvFwd = new ServiceForwarding(serviceName, m_server, conflate);
     iter = m_serviceConnections.insert(ServiceForwardingMap::value_type(serviceName, srvFwd)).first;
 
     m_client.subscribe(serviceName, srvFwd, &ServiceForwarding::forward);
   }
 
   // add this connection to service
-  iter->second->connections().insert(connection);
+  iter->second->addConnection(connection);
 }
 
 //----------------------------------------------------------------------------------
 
 inline void ServiceManager::removeConnection(const std::string &serviceName,
                                              std::shared_ptr<WsServer::Connection> connection) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   auto iter = m_serviceConnections.find(serviceName);
 
   if (m_serviceConnections.end() != iter) {
-    iter->second->connections().erase(connection);
-
-    if (iter->second->connections().empty()) {
+    if (iter->second->removeConnection(connection)) {
       m_client.unsubscribe(iter->first, iter->second, &ServiceForwarding::forward);
       delete iter->second;
       m_serviceConnections.erase(iter);
@@ -208,13 +264,12 @@ inline void ServiceManager::removeConnection(const std::string &serviceName,
 //----------------------------------------------------------------------------------
 
 inline void ServiceManager::removeConnection(std::shared_ptr<WsServer::Connection> connection) {
+  std::lock_guard<std::mutex> lock(m_mutex);
   std::set<std::string> servicesRemoval;
 
   for (auto iter = m_serviceConnections.begin(); iter != m_serviceConnections.end(); ++iter) {
-    iter->second->connections().erase(connection);
-
     // if no connection remaining, unsubscribe from service
-    if (iter->second->connections().empty())
+    if (iter->second->removeConnection(connection))
       servicesRemoval.insert(iter->first);
   }
 
@@ -233,6 +288,21 @@ inline void ServiceManager::removeConnection(std::shared_ptr<WsServer::Connectio
 //----------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------
 
+void reportSlowConnections(Endpoint &endpoint) {
+  for (auto connection : endpoint.get_connections()) {
+    if (0 == connection->queued_messages() && 0 == connection->dropped_messages())
+      continue;
+
+    std::cout << "Slow connection " << connection->remote_endpoint_address << ":" << connection->remote_endpoint_port
+              << ". lag : " << connection->queued_messages() << " messages (" << connection->queued_bytes()
+              << " bytes), dropped : " << connection->dropped_messages()
+              << ", conflated : " << connection->conflated_messages() << std::endl;
+  }
+}
+
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+
 Endpoint &addEndpoint(WsServer &server, const std::string &endpoint) {
   std::cout << "Adding endpoint : " << endpoint << std::endl;
   return server.endpoint[endpoint];
@@ -241,12 +311,35 @@ Endpoint &addEndpoint(WsServer &server, const std::string &endpoint) {
 //----------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------
 
+// Usage : dqm4hep-ws-server [port] [max-queued-messages] [max-queued-bytes] [conflation-regex]
+//                            [n-threads] [deflate-window-bits] [deflate-min-size]
+//
+// conflation-regex : the services matching it send only their latest update to a slow connection,
+// the updates still waiting to be sent are replaced. Empty by default: no service is conflated,
+// every update is sent (or dropped by the queue limits). Use e.g. "^/monitoring/.*" for services
+// whose intermediate updates can be skipped
 int main(int argc, char **argv) {
   // websocket port
   const int port = argc > 1 ? atoi(argv[1]) : 2506;
+  // per connection limits of the updates waiting to be sent
+  const size_t maxQueuedMessages = argc > 2 ? atol(argv[2]) : defaultMaxQueuedMessages;
+  const size_t maxQueuedBytes = argc > 3 ? atol(argv[3]) : defaultMaxQueuedBytes;
+  // services only sending their latest update to slow connections (none by default)
+  const std::string conflationRegex = argc > 4 ? argv[4] : "";
+  // number of asio threads
+  const size_t nThreads = argc > 5 ? atol(argv[5]) : std::max(1U, std::thread::hardware_concurrency());
+  // permessage-deflate window bits (0 to disable) and minimum size of the compressed messages
+  const int deflateWindowBits = argc > 6 ? atoi(argv[6]) : defaultDeflateWindowBits;
+  const size_t deflateMinSize = argc > 7 ? atol(argv[7]) : defaultDeflateMinSize;
 
   WsServer webServer;
   webServer.config.port = port;
+  webServer.config.thread_pool_size = nThreads;
+  webServer.config.max_queued_messages = maxQueuedMessages;
+  webServer.config.max_queued_bytes = maxQueuedBytes;
+  webServer.config.permessage_deflate = (deflateWindowBits > 0);
+  webServer.config.deflate_window_bits = deflateWindowBits;
+  webServer.config.deflate_min_size = deflateMinSize;
 
   Client client;
 
@@ -265,9 +358,10 @@ int main(int argc, char **argv) {
   browserGetServices.on_message = [&webServer](std::shared_ptr<WsServer::Connection> connection,
                                                std::shared_ptr<WsServer::Message> message) {
 
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string uid(messageStr, 0, maxNumberStrLen);
-    std::string serviceRegex(messageStr, maxNumberStrLen);
+    const char *messageData = message->data();
+    size_t messageSize = message->size();
+    std::string uid(messageData, std::min(messageSize, maxNumberStrLen));
+    std::string serviceRegex(messageData + uid.size(), messageSize - uid.size());
 
     DimBrowser browser;
     int nServices = browser.getServices(serviceRegex.c_str());
@@ -305,8 +399,7 @@ int main(int argc, char **argv) {
   browserGetServers.on_message = [&webServer](std::shared_ptr<WsServer::Connection> connection,
                                               std::shared_ptr<WsServer::Message> message) {
 
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string uid(messageStr, 0, maxNumberStrLen);
+    std::string uid(message->data(), std::min(message->size(), maxNumberStrLen));
 
     DimBrowser browser;
     browser.getServers();
@@ -342,9 +435,10 @@ int main(int argc, char **argv) {
   browserGetServerServices.on_message = [&webServer](std::shared_ptr<WsServer::Connection> connection,
                                                      std::shared_ptr<WsServer::Message> message) {
 
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string uid(messageStr, 0, maxNumberStrLen);
-    std::string serviceRegex(messageStr, maxNumberStrLen);
+    const char *messageData = message->data();
+    size_t messageSize = message->size();
+    std::string uid(messageData, std::min(messageSize, maxNumberStrLen));
+    std::string serviceRegex(messageData + uid.size(), messageSize - uid.size());
 
     DimBrowser browser;
     browser.getServerServices(serviceRegex.c_str());
@@ -380,9 +474,10 @@ int main(int argc, char **argv) {
   browserGetServerClients.on_message = [&webServer](std::shared_ptr<WsServer::Connection> connection,
                                                     std::shared_ptr<WsServer::Message> message) {
 
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string uid(messageStr, 0, maxNumberStrLen);
-    std::string serviceRegex(messageStr, maxNumberStrLen);
+    const char *messageData = message->data();
+    size_t messageSize = message->size();
+    std::string uid(messageData, std::min(messageSize, maxNumberStrLen));
+    std::string serviceRegex(messageData + uid.size(), messageSize - uid.size());
 
     DimBrowser browser;
     browser.getServerClients(serviceRegex.c_str());
@@ -423,10 +518,13 @@ int main(int argc, char **argv) {
     }
 
     // Extract command name and content
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string commandName(messageStr, 0, MAX_NAME);
+    const char *messageData = message->data();
+    std::string commandName(messageData, MAX_NAME);
     trim(commandName);
-    std::string buffer(messageStr, MAX_NAME);
+
+    // the command contents are sent from the message buffer, without copy
+    Buffer buffer;
+    buffer.adopt(messageData + MAX_NAME, message->size() - MAX_NAME);
 
     // Send command
     client.sendCommand(commandName, buffer, true);
@@ -445,11 +543,11 @@ int main(int argc, char **argv) {
     }
 
     // Extract command name and content
-    std::string messageStr(message->buffer()->begin_iptr(), message->size());
-    std::string rpcName(messageStr, 0, MAX_NAME);
-    std::string rpcUid(messageStr, MAX_NAME, maxNumberStrLen);
+    const char *messageData = message->data();
+    std::string rpcName(messageData, MAX_NAME);
+    std::string rpcUid(messageData + MAX_NAME, maxNumberStrLen);
     trim(rpcName);
-    std::string buffer(messageStr, MAX_NAME + maxNumberStrLen);
+    std::string buffer(messageData + MAX_NAME + maxNumberStrLen, message->size() - MAX_NAME - maxNumberStrLen);
     std::string response;
 
     std::cout << "Rpc name : " << rpcName << std::endl;
@@ -472,12 +570,23 @@ int main(int argc, char **argv) {
 
   /* Service manager handling the endpoint for services */
   auto &service = addEndpoint(webServer, "^/dqmnet/service/?$");
-  ServiceManager serviceManager(client, webServer, service);
+  ServiceManager serviceManager(client, webServer, service, conflationRegex);
 
   /* Start web server */
-  std::thread serverThread([&webServer]() { webServer.start(); });
+  std::atomic<bool> running(true);
+  std::thread serverThread([&webServer, &running]() {
+    webServer.start();
+    running = false;
+  });
+
+  /* Report the connections not keeping up with the service updates */
+  for (unsigned int seconds = 1; running; ++seconds) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    if (0 == seconds % 10)
+      reportSlowConnections(service);
+  }
 
-  std::this_thread::sleep_for(std::chrono::seconds(2));
   serverThread.join();
 
   return 0;
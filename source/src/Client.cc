@@ -29,6 +29,9 @@
 #include "dqm4hep/Client.h"
 #include "dqm4hep/RequestHandler.h"
 
+// -- std headers
+#include <atomic>
+
 namespace dqm4hep {
 
   namespace net {
@@ -44,6 +47,24 @@ namespace dqm4hep {
         delete iter->second;
 
       m_serviceHandlerMap.clear();
+
+      std::lock_guard<std::mutex> lock(m_rpcChannelMutex);
+      m_rpcChannelMap.clear();
+      m_asyncRpcChannelMap.clear();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    std::future<Buffer> Client::sendRequestAsync(const std::string &name, const Buffer &request) const {
+      auto promise = std::make_shared<std::promise<Buffer>>();
+
+      this->asyncRpcChannel(name)->sendRequest(request, [promise](const Buffer &response) {
+        Buffer buffer;
+        buffer.copy(response.begin(), response.size());
+        promise->set_value(std::move(buffer));
+      });
+
+      return promise->get_future();
     }
 
     //-------------------------------------------------------------------------------------------------
@@ -56,6 +77,20 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    bool Client::queryServerInfo(const std::string &serverName, ServerInfo &serverInfo) const {
+      Buffer request;
+      request.copy(ServerInfo::binaryRequest);
+      bool decoded(false);
+
+      this->sendRequest("/" + serverName + "/info", request, [&serverInfo, &decoded](const Buffer &buffer) {
+        decoded = serverInfo.decode(buffer.begin(), buffer.size());
+      });
+
+      return decoded;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     bool Client::hasSubscribed(const std::string &name) const {
       return (m_serviceHandlerMap.end() != m_serviceHandlerMap.find(name));
     }
@@ -71,5 +106,249 @@ namespace dqm4hep {
     void Client::notifyServerOnExit(const std::string &serverName) {
       DimClient::setExitHandler(serverName.c_str());
     }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Client::RpcChannelPtr Client::rpcChannel(const std::string &name) const {
+      std::lock_guard<std::mutex> lock(m_rpcChannelMutex);
+      auto findIter = m_rpcChannelMap.find(name);
+
+      if (m_rpcChannelMap.end() != findIter)
+        return findIter->second;
+
+      auto channel = std::make_shared<RpcChannel>(name);
+      m_rpcChannelMap.insert(RpcChannelMap::value_type(name, channel));
+      return channel;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Client::closeRpcChannel(const std::string &name, const RpcChannelPtr &channel) const {
+      std::lock_guard<std::mutex> lock(m_rpcChannelMutex);
+      auto findIter = m_rpcChannelMap.find(name);
+
+      // another thread may already have replaced it
+      if (m_rpcChannelMap.end() != findIter && channel == findIter->second)
+        m_rpcChannelMap.erase(findIter);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Client::AsyncRpcChannelPtr Client::asyncRpcChannel(const std::string &name) const {
+      std::lock_guard<std::mutex> lock(m_rpcChannelMutex);
+      auto findIter = m_asyncRpcChannelMap.find(name);
+
+      if (m_asyncRpcChannelMap.end() != findIter)
+        return findIter->second;
+
+      auto channel = std::make_shared<AsyncRpcChannel>(name);
+      m_asyncRpcChannelMap.insert(AsyncRpcChannelMap::value_type(name, channel));
+      return channel;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    // The no-link buffer is copied by dim in the rpc info, so its address
+    // identifies a reply that did not come from the server
+    static char rpcNoLink = 0;
+
+    Client::RpcChannel::RpcChannel(const std::string &name) : DimRpcInfo(name.c_str(), (void *)&rpcNoLink, 1) {
+      /* nop */
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    bool Client::RpcChannel::sendRequest(const Buffer &request) {
+      {
+        std::lock_guard<std::mutex> lock(m_replyMutex);
+        m_replied = false;
+      }
+
+      // the previous reply may have been notified while dim was still in the rpc
+      // callback, which resets the waiting state on return. The callback holds the
+      // dim lock: taking it once makes sure it is over before re-arming the rpc
+      dim_lock();
+      dim_unlock();
+
+      this->setData((void *)request.begin(), request.size());
+
+      std::unique_lock<std::mutex> lock(m_replyMutex);
+      m_replyCond.wait(lock, [this]() { return m_replied; });
+      return m_linked;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    const std::vector<char> &Client::RpcChannel::response() const {
+      return m_response;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Client::RpcChannel::rpcInfoHandler() {
+      // no data copy mode: itsData points to the received buffer, only valid in this callback.
+      // Copy it here instead of in DimRpcInfo, which loses track of its own buffer when reused
+      std::lock_guard<std::mutex> lock(m_replyMutex);
+      m_linked = (itsData != itsNolinkBuf);
+
+      if (m_linked)
+        m_response.assign((char *)itsData, (char *)itsData + itsSize);
+      else
+        m_response.clear();
+
+      m_replied = true;
+      m_replyCond.notify_all();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    std::mutex &Client::RpcChannel::mutex() {
+      return m_mutex;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    // Correlation ids are unique in the process: the channels of several clients
+    // subscribed to the same rpc output share a dim connection and all get the responses
+    static std::atomic<uint32_t> nextCorrelationId(1);
+
+    static uint32_t newCorrelationId() {
+      uint32_t correlationId = nextCorrelationId++;
+
+      // 0 is reserved
+      while (0 == correlationId)
+        correlationId = nextCorrelationId++;
+
+      return correlationId;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Client::AsyncRpcChannel::AsyncRpcChannel(const std::string &name)
+        : DimInfo(), m_rpcInName(RequestHandler::asyncRpcName(name) + "/RpcIn") {
+      // subscribe once the members are initialized, infoHandler() may be called right away
+      const std::string rpcOutName(RequestHandler::asyncRpcName(name) + "/RpcOut");
+      this->subscribe((char *)rpcOutName.c_str(), 0, (void *)nullptr, 0, nullptr);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Client::AsyncRpcChannel::~AsyncRpcChannel() {
+      // release the subscription before the members go away: once
+      // released, dim can not call infoHandler() anymore
+      if (itsId)
+        dic_release_service(itsId);
+
+      itsId = 0;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Client::AsyncRpcChannel::sendRequest(const Buffer &request, ResponseFunction function) {
+      std::string payload(sizeof(uint32_t) + request.size(), '\0');
+
+      if (0 != request.size())
+        memcpy(&payload[sizeof(uint32_t)], request.begin(), request.size());
+
+      bool send(false), unreachable(false);
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (DOWN == m_state) {
+          unreachable = true;
+        } else {
+          uint32_t correlationId = newCorrelationId();
+
+          memcpy(&payload[0], &correlationId, sizeof(correlationId));
+          m_pendingRequests[correlationId] = std::move(function);
+
+          // the response would be lost if the output subscription is not there yet
+          if (CONNECTED == m_state)
+            send = true;
+          else
+            m_queuedRequests[correlationId] = std::move(payload);
+        }
+      }
+
+      if (unreachable) {
+        Buffer response;
+        function(response);
+        return;
+      }
+
+      if (send)
+        DimClient::sendCommandNB(m_rpcInName.c_str(), (void *)payload.data(), payload.size());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Client::AsyncRpcChannel::infoHandler() {
+      // no data copy mode: itsData points to the received buffer, only valid in this callback
+      char *data = (char *)itsData;
+      int size = itsSize;
+      std::vector<ResponseFunction> failedFunctions;
+      QueuedRequestMap queuedRequests;
+      ResponseFunction function;
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // no-link callbacks are not run on behalf of a received service
+        if (-1 == dic_get_quality(0)) {
+          // server exit. Dim subscribes again when it comes back
+          m_state = DOWN;
+
+          for (auto &pendingRequest : m_pendingRequests)
+            failedFunctions.push_back(std::move(pendingRequest.second));
+
+          m_pendingRequests.clear();
+          m_queuedRequests.clear();
+        } else if (CONNECTED != m_state) {
+          // first update is the current rpc output, not a response for us.
+          // Requests sent to a previous server instance will never be answered
+          m_state = CONNECTED;
+          queuedRequests.swap(m_queuedRequests);
+
+          for (auto iter = m_pendingRequests.begin(); m_pendingRequests.end() != iter;) {
+            if (queuedRequests.end() != queuedRequests.find(iter->first)) {
+              ++iter;
+              continue;
+            }
+
+            failedFunctions.push_back(std::move(iter->second));
+            iter = m_pendingRequests.erase(iter);
+          }
+        } else if (nullptr != data && size >= (int)sizeof(uint32_t)) {
+          uint32_t correlationId = 0;
+          memcpy(&correlationId, data, sizeof(correlationId));
+          auto findIter = m_pendingRequests.find(correlationId);
+
+          if (m_pendingRequests.end() != findIter) {
+            function = std::move(findIter->second);
+            m_pendingRequests.erase(findIter);
+          }
+        }
+      }
+
+      for (auto &queuedRequest : queuedRequests)
+        DimClient::sendCommandNB(m_rpcInName.c_str(), (void *)queuedRequest.second.data(), queuedRequest.second.size());
+
+      for (auto &failedFunction : failedFunctions) {
+        Buffer response;
+        failedFunction(response);
+      }
+
+      if (function) {
+        Buffer response;
+
+        if (size > (int)sizeof(uint32_t))
+          response.adopt(data + sizeof(uint32_t), size - sizeof(uint32_t));
+
+        function(response);
+      }
+    }
   }
 }
@@ -28,6 +28,9 @@
 // -- dqm4hep headers
 #include "dqm4hep/DQMNet.h"
 
+// -- std headers
+#include <vector>
+
 namespace dqm4hep {
 
   namespace net {
@@ -38,6 +41,112 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
+    /**
+     *  @brief  The free lists of one thread, by size class of 16 bytes
+     */
+    class BufferModelFreeLists {
+    public:
+      static const size_t granularity = 16;       ///< The size class width
+      static const size_t nSizeClasses = 16;      ///< The number of size classes (blocks up to 256 bytes)
+      static const size_t maxFreeBlocks = 256;    ///< The maximum number of free blocks kept per size class
+
+      ~BufferModelFreeLists();
+
+      std::vector<void *> m_freeBlocks[nSizeClasses];
+    };
+
+    // never destroyed: tells whether the free lists of this thread are gone
+    static thread_local bool threadFreeListsDestroyed = false;
+    static thread_local BufferModelFreeLists threadFreeLists;
+
+    //-------------------------------------------------------------------------------------------------
+
+    BufferModelFreeLists::~BufferModelFreeLists() {
+      threadFreeListsDestroyed = true;
+
+      for (auto &freeBlocks : m_freeBlocks)
+        for (auto block : freeBlocks)
+          ::operator delete(block);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void *BufferModelPool::allocate(size_t size) {
+      const size_t sizeClass = (size + BufferModelFreeLists::granularity - 1) / BufferModelFreeLists::granularity;
+
+      if (0 == sizeClass || sizeClass > BufferModelFreeLists::nSizeClasses || threadFreeListsDestroyed)
+        return ::operator new(size);
+
+      auto &freeBlocks = threadFreeLists.m_freeBlocks[sizeClass - 1];
+
+      if (freeBlocks.empty())
+        return ::operator new(sizeClass * BufferModelFreeLists::granularity);
+
+      void *block = freeBlocks.back();
+      freeBlocks.pop_back();
+      return block;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void BufferModelPool::deallocate(void *ptr, size_t size) {
+      const size_t sizeClass = (size + BufferModelFreeLists::granularity - 1) / BufferModelFreeLists::granularity;
+
+      if (0 == sizeClass || sizeClass > BufferModelFreeLists::nSizeClasses || threadFreeListsDestroyed) {
+        ::operator delete(ptr);
+        return;
+      }
+
+      auto &freeBlocks = threadFreeLists.m_freeBlocks[sizeClass - 1];
+
+      if (freeBlocks.size() >= BufferModelFreeLists::maxFreeBlocks) {
+        ::operator delete(ptr);
+        return;
+      }
+
+      freeBlocks.push_back(ptr);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    PayloadPtr Payload::create(const char *buffer, size_t s) {
+      return Payload::create(std::string(buffer, s));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    PayloadPtr Payload::create(std::string &&contents) {
+      return std::allocate_shared<const Payload>(BufferModelAllocator<Payload>(), std::move(contents));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Payload::Payload(std::string &&contents) : m_contents(std::move(contents)) {
+      /* nop */
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    const char *Payload::begin() const {
+      return m_contents.data();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    const char *Payload::end() const {
+      return m_contents.data() + m_contents.size();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    size_t Payload::size() const {
+      return m_contents.size();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
     RawBuffer::RawBuffer() {
       this->adopt(NullBuffer::buffer, NullBuffer::size);
     }
@@ -83,20 +192,133 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
+    const size_t Buffer::inlineCapacity;
+
+    //-------------------------------------------------------------------------------------------------
+
     Buffer::Buffer() {
-      this->adopt(NullBuffer::buffer, NullBuffer::size);
+      /* nop */
     }
 
     //-------------------------------------------------------------------------------------------------
 
     Buffer::Buffer(Buffer &&buffer) {
       m_model = std::move(buffer.m_model);
+      m_payload = std::move(buffer.m_payload);
+      m_segments = std::move(buffer.m_segments);
+      m_segmentPayloads = std::move(buffer.m_segmentPayloads);
+      buffer.m_segments.clear();
+      buffer.m_segmentPayloads.clear();
+
+      if (buffer.isInline())
+        this->copy(buffer.m_view.begin(), buffer.m_view.size());
+      else
+        m_view.adopt(buffer.m_view.begin(), buffer.m_view.size());
+
+      buffer.m_view.adopt(NullBuffer::buffer, NullBuffer::size);
     }
 
     //-------------------------------------------------------------------------------------------------
 
     std::shared_ptr<BufferModel> Buffer::createModel() const {
-      return std::make_shared<BufferModel>();
+      return std::allocate_shared<BufferModel>(BufferModelAllocator<BufferModel>());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::copy(const std::string &value) {
+      if (value.size() <= inlineCapacity) {
+        this->copy(value.c_str(), value.size());
+        return;
+      }
+
+      auto m = this->createModel<std::string>();
+      m->copy(value);
+      this->setModel(m);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::copy(const char *buffer, size_t s) {
+      if (s > inlineCapacity) {
+        this->copy(std::string(buffer, s));
+        return;
+      }
+
+      char *inlineBuffer = reinterpret_cast<char *>(&m_inlineStorage);
+
+      if (0 != s)
+        memmove(inlineBuffer, buffer, s);
+
+      m_model.reset();
+      m_payload.reset();
+      this->clearSegments();
+      m_view.adopt(inlineBuffer, s);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::share(PayloadPtr p) {
+      if (!p)
+        return;
+
+      m_model.reset();
+      this->clearSegments();
+      m_view.adopt(p->begin(), p->size());
+      m_payload = std::move(p);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::addSegment(const char *buffer, size_t s) {
+      if (!this->isSegmented()) {
+        m_model.reset();
+        m_view.adopt(NullBuffer::buffer, NullBuffer::size);
+      }
+
+      // concatenated again on demand
+      m_payload.reset();
+      m_segments.push_back(BufferSegment{buffer, s});
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::addSegment(PayloadPtr p) {
+      if (!p)
+        return;
+
+      this->addSegment(p->begin(), p->size());
+      m_segmentPayloads.push_back(std::move(p));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    bool Buffer::isSegmented() const {
+      return !m_segments.empty();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    const BufferSegments &Buffer::segments() const {
+      return m_segments;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    PayloadPtr Buffer::payload() const {
+      if (this->isSegmented())
+        this->flatten();
+
+      if (m_model)
+        return Payload::create(this->begin(), this->size());
+
+      // copied once, then viewed: the next consumers share it
+      if (!m_payload) {
+        m_payload = Payload::create(m_view.begin(), m_view.size());
+        m_view.adopt(m_payload->begin(), m_payload->size());
+      }
+
+      return m_payload;
     }
 
     //-------------------------------------------------------------------------------------------------
@@ -105,38 +327,105 @@ namespace dqm4hep {
       if (!m)
         return;
       m_model = m;
+      m_payload.reset();
+      this->clearSegments();
     }
 
     //-------------------------------------------------------------------------------------------------
 
     const char *Buffer::begin() const {
-      return m_model->raw().begin();
+      if (this->isSegmented())
+        this->flatten();
+
+      return m_model ? m_model->raw().begin() : m_view.begin();
     }
 
     //-------------------------------------------------------------------------------------------------
 
     const char *Buffer::end() const {
-      return m_model->raw().end();
+      if (this->isSegmented())
+        this->flatten();
+
+      return m_model ? m_model->raw().end() : m_view.end();
     }
 
     //-------------------------------------------------------------------------------------------------
 
     size_t Buffer::size() const {
-      return m_model->raw().size();
+      if (this->isSegmented()) {
+        size_t totalSize(0);
+
+        for (const auto &segment : m_segments)
+          totalSize += segment.size;
+
+        return totalSize;
+      }
+
+      return m_model ? m_model->raw().size() : m_view.size();
     }
 
     //-------------------------------------------------------------------------------------------------
 
     void Buffer::adopt(const char *buffer, size_t s) {
-      auto m = this->createModel();
-      m->handle(buffer, s);
-      this->setModel(m);
+      m_model.reset();
+      m_payload.reset();
+      this->clearSegments();
+      m_view.adopt(buffer, s);
     }
 
     //-------------------------------------------------------------------------------------------------
 
     BufferModelPtr Buffer::model() const {
+      if (this->isSegmented())
+        this->flatten();
+
+      if (!m_model) {
+        // the inline contents must outlive this buffer in the model: copy it
+        if (this->isInline()) {
+          auto m = this->createModel<std::string>();
+          m->copy(std::string(m_view.begin(), m_view.size()));
+          m_model = m;
+        } else if (m_payload) {
+          auto m = this->createModel<PayloadPtr>();
+          m->copy(m_payload);
+          m_model = m;
+        } else {
+          m_model = this->createModel();
+          m_model->handle(m_view.begin(), m_view.size());
+        }
+      }
+
       return m_model;
     }
+
+    //-------------------------------------------------------------------------------------------------
+
+    bool Buffer::isInline() const {
+      return (m_view.begin() == reinterpret_cast<const char *>(&m_inlineStorage));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::flatten() const {
+      if (m_payload)
+        return;
+
+      std::string contents;
+      contents.reserve(this->size());
+
+      for (const auto &segment : m_segments)
+        contents.append(segment.address, segment.size);
+
+      // the segments are kept: still sent without concatenation
+      m_payload = Payload::create(std::move(contents));
+      m_view.adopt(m_payload->begin(), m_payload->size());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Buffer::clearSegments() {
+      m_segments.clear();
+      m_segmentPayloads.clear();
+    }
   }
 }
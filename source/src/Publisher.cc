@@ -0,0 +1,178 @@
+/// \file Publisher.cc
+/*
+ *
+ * Publisher.cc source template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "dqm4hep/Publisher.h"
+
+// -- std headers
+#include <algorithm>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    Publisher::Update::Update(Service *pService, Buffer &&buffer, const std::vector<int> &clientIds)
+        : m_pService(pService), m_buffer(std::move(buffer)), m_clientIds(clientIds) {
+      /* nop */
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    Publisher::Publisher(size_t maxQueueSize, OverflowPolicy policy)
+        : m_maxQueueSize(std::max(size_t(1), maxQueueSize)), m_policy(policy) {
+      m_thread = std::thread(&Publisher::run, this);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Publisher::~Publisher() {
+      std::deque<Update> updates;
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        updates.swap(m_updates);
+      }
+
+      m_queueCondition.notify_all();
+      m_sentCondition.notify_all();
+      m_thread.join();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Publisher::publish(Service *pService, Buffer &&buffer, const std::vector<int> &clientIds) {
+      // released on return, outside of the mutex
+      std::deque<Update> dropped;
+
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_policy == BLOCK)
+          m_sentCondition.wait(lock, [this]() { return m_stop || m_updates.size() < m_maxQueueSize; });
+
+        if (m_stop || (m_policy == DROP_NEWEST && m_updates.size() >= m_maxQueueSize)) {
+          ++m_nDroppedUpdates;
+          dropped.emplace_back(pService, std::move(buffer), clientIds);
+        } else {
+          while (m_updates.size() >= m_maxQueueSize) {
+            ++m_nDroppedUpdates;
+            dropped.push_back(std::move(m_updates.front()));
+            m_updates.pop_front();
+          }
+
+          m_updates.emplace_back(pService, std::move(buffer), clientIds);
+        }
+      }
+
+      m_queueCondition.notify_one();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Publisher::discard(Service *pService) {
+      // released on return, outside of the mutex
+      std::deque<Update> dropped;
+
+      // the publisher thread holds the dim lock while sending: once we have it, the
+      // update being sent is either over or skipped. Recursive, so this never waits
+      // when called from a dim callback
+      dim_lock();
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::deque<Update> updates;
+        updates.swap(m_updates);
+
+        // updates are not assignable, rebuild the queue instead of erasing
+        while (!updates.empty()) {
+          (updates.front().m_pService == pService ? dropped : m_updates).push_back(std::move(updates.front()));
+          updates.pop_front();
+        }
+
+        if (m_pSendingService == pService)
+          m_pSendingService = nullptr;
+      }
+      dim_unlock();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    size_t Publisher::maxQueueSize() const {
+      return m_maxQueueSize;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Publisher::OverflowPolicy Publisher::overflowPolicy() const {
+      return m_policy;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    size_t Publisher::nDroppedUpdates() const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_nDroppedUpdates;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Publisher::run() {
+      while (true) {
+        std::deque<Update> updates;
+
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_pSendingService = nullptr;
+          m_sentCondition.notify_all();
+          m_queueCondition.wait(lock, [this]() { return m_stop || !m_updates.empty(); });
+
+          if (m_stop)
+            return;
+
+          updates.push_back(std::move(m_updates.front()));
+          m_updates.pop_front();
+          m_pSendingService = updates.front().m_pService;
+        }
+
+        // dim lock first, as in discard(). Not sent if discarded in the meantime
+        dim_lock();
+        bool discarded = false;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          discarded = (m_pSendingService == nullptr);
+        }
+
+        if (!discarded)
+          updates.front().m_pService->writeData(updates.front().m_buffer, updates.front().m_clientIds);
+
+        dim_unlock();
+      }
+    }
+  }
+}
@@ -31,8 +31,31 @@ namespace dqm4hep {
 
   namespace net {
 
+    /**
+     *  @brief  Append the segments of a buffer to a dim segment list.
+     *          A contiguous buffer is a single segment
+     */
+    static void appendSegments(const Buffer &buffer, std::vector<DIS_SEGMENT> &segments) {
+      if (!buffer.isSegmented()) {
+        if (0 != buffer.size())
+          segments.push_back(DIS_SEGMENT{(void *)buffer.begin(), (int)buffer.size()});
+        return;
+      }
+
+      for (const auto &segment : buffer.segments())
+        segments.push_back(DIS_SEGMENT{(void *)segment.address, (int)segment.size});
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     RequestHandler::~RequestHandler() {
       this->stopHandlingRequest();
+
+      // pending responses may outlive the handler and the worker pool
+      if (this->isDeferred()) {
+        std::lock_guard<std::mutex> lock(m_deferredContext->m_mutex);
+        m_deferredContext->m_pWorkerPool = nullptr;
+      }
     }
 
     //-------------------------------------------------------------------------------------------------
@@ -49,9 +72,22 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    std::string RequestHandler::asyncRpcName(const std::string &rname) {
+      return rname + "/async";
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     void RequestHandler::startHandlingRequest() {
       if (!this->isHandlingRequest()) {
         m_pRpc = new Rpc(this);
+        m_pAsyncRpc = new AsyncRpc(this);
+
+        if (this->isDeferred()) {
+          std::lock_guard<std::mutex> lock(m_deferredContext->m_mutex);
+          m_deferredContext->m_pRpc = m_pRpc;
+          m_deferredContext->m_pAsyncRpc = m_pAsyncRpc;
+        }
       }
     }
 
@@ -59,8 +95,25 @@ namespace dqm4hep {
 
     void RequestHandler::stopHandlingRequest() {
       if (this->isHandlingRequest()) {
+        if (this->isDeferred()) {
+          // dim lock first, as in Response::send()
+          std::deque<WorkerPool::Task> queuedTasks;
+          dim_lock();
+          {
+            std::lock_guard<std::mutex> lock(m_deferredContext->m_mutex);
+            m_deferredContext->m_pRpc = nullptr;
+            m_deferredContext->m_pAsyncRpc = nullptr;
+            queuedTasks.swap(m_deferredContext->m_queuedTasks);
+          }
+          // dropped outside of the mutex: their responses are destroyed
+          queuedTasks.clear();
+          dim_unlock();
+        }
+
         delete m_pRpc;
         m_pRpc = nullptr;
+        delete m_pAsyncRpc;
+        m_pAsyncRpc = nullptr;
       }
     }
 
@@ -82,6 +135,52 @@ namespace dqm4hep {
       m_requestSignal.process(request, response);
     }
 
+    //-------------------------------------------------------------------------------------------------
+
+    bool RequestHandler::isDeferred() const {
+      return (nullptr != m_deferredContext);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void RequestHandler::deferRequest(const char *data, int size, bool pipelined, uint32_t correlationId) {
+      auto context = m_deferredContext;
+      // the dim buffer is only valid during the rpc handler
+      auto request = std::make_shared<std::string>(data, size);
+      ResponsePtr response(new Response(context, DimServer::getClientId(), pipelined, correlationId));
+
+      WorkerPool::Task task = [context, request, response]() mutable {
+        // the slot of this request is released when the response is sent
+        response->m_holdsSlot = true;
+        Buffer requestBuffer;
+
+        if (!request->empty())
+          requestBuffer.adopt(request->data(), request->size());
+
+        context->m_signal.process(requestBuffer, response);
+        // sent here unless the handler kept it for later
+        response.reset();
+      };
+
+      WorkerPool *pWorkerPool = nullptr;
+
+      {
+        std::lock_guard<std::mutex> lock(context->m_mutex);
+
+        if (nullptr == context->m_pWorkerPool)
+          return;
+
+        if (context->m_nInFlight < context->m_maxConcurrency) {
+          context->m_nInFlight++;
+          pWorkerPool = context->m_pWorkerPool;
+        } else
+          context->m_queuedTasks.push_back(std::move(task));
+      }
+
+      if (nullptr != pWorkerPool)
+        pWorkerPool->post(std::move(task));
+    }
+
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
@@ -95,6 +194,17 @@ namespace dqm4hep {
     void RequestHandler::Rpc::rpcHandler() {
       char *data = (char *)this->getData();
       int size = this->getSize();
+
+      // set by a previous deferred request, dim only clears it for clients with a timeout
+      itsKilled = 0;
+
+      if (m_pHandler->isDeferred()) {
+        // no reply now, the response is sent when ready
+        itsKilled = 1;
+        m_pHandler->deferRequest(data, nullptr != data ? size : 0, false, 0);
+        return;
+      }
+
       Buffer request;
 
       if (nullptr != data && size != 0)
@@ -102,12 +212,138 @@ namespace dqm4hep {
 
       Buffer response;
       m_pHandler->handleRequest(request, response);
+
+      if (response.isSegmented()) {
+        std::vector<DIS_SEGMENT> segments;
+        appendSegments(response, segments);
+        this->setData(segments.data(), segments.size());
+        return;
+      }
+
       this->setData((void *)response.begin(), response.size());
     }
 
     //-------------------------------------------------------------------------------------------------
     //-------------------------------------------------------------------------------------------------
 
+    RequestHandler::AsyncRpc::AsyncRpc(RequestHandler *pHandler)
+        : DimRpc((char *)RequestHandler::asyncRpcName(pHandler->name()).c_str(), "C", "C"), m_pHandler(pHandler) {
+      /* nop */
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void RequestHandler::AsyncRpc::rpcHandler() {
+      char *data = (char *)this->getData();
+      int size = this->getSize();
+      uint32_t correlationId = 0;
+
+      // may still be set by a previous deferred request, see Rpc::rpcHandler()
+      itsKilled = 0;
+
+      // a malformed request gets the reserved id 0 back, never a stale reply
+      if (nullptr == data || size < (int)sizeof(correlationId)) {
+        this->setData((void *)&correlationId, sizeof(correlationId));
+        return;
+      }
+
+      memcpy(&correlationId, data, sizeof(correlationId));
+
+      if (m_pHandler->isDeferred()) {
+        // no reply now, the response is sent when ready
+        itsKilled = 1;
+        m_pHandler->deferRequest(data + sizeof(correlationId), size - sizeof(correlationId), true, correlationId);
+        return;
+      }
+
+      Buffer request;
+
+      if (size > (int)sizeof(correlationId))
+        request.adopt(data + sizeof(correlationId), size - sizeof(correlationId));
+
+      Buffer response;
+      m_pHandler->handleRequest(request, response);
+
+      // gathered once in the dim reply buffer
+      m_segments.clear();
+      m_segments.push_back(DIS_SEGMENT{(void *)&correlationId, sizeof(correlationId)});
+      appendSegments(response, m_segments);
+      this->setData(m_segments.data(), m_segments.size());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    Response::Response(std::shared_ptr<RequestHandler::DeferredContext> context, int clientId, bool pipelined,
+                       uint32_t correlationId)
+        : m_context(context), m_clientId(clientId), m_pipelined(pipelined), m_correlationId(correlationId) {
+      /* nop */
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Response::~Response() {
+      this->send();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Buffer &Response::buffer() {
+      return m_buffer;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Response::send() {
+      if (m_sent.exchange(true))
+        return;
+
+      std::vector<DIS_SEGMENT> segments;
+
+      if (m_pipelined)
+        segments.push_back(DIS_SEGMENT{(void *)&m_correlationId, sizeof(m_correlationId)});
+
+      if (m_pipelined || m_buffer.isSegmented())
+        appendSegments(m_buffer, segments);
+
+      WorkerPool::Task nextTask;
+      WorkerPool *pWorkerPool = nullptr;
+
+      // the dim thread takes the dim lock then the context mutex (deferRequest())
+      dim_lock();
+      {
+        std::lock_guard<std::mutex> lock(m_context->m_mutex);
+        DimRpc *pRpc = m_pipelined ? static_cast<DimRpc *>(m_context->m_pAsyncRpc) : m_context->m_pRpc;
+
+        if (nullptr != pRpc) {
+          if (!segments.empty())
+            pRpc->setData(segments.data(), segments.size());
+          else
+            pRpc->setData((void *)m_buffer.begin(), m_buffer.size());
+
+          int clientIds[2] = {m_clientId, 0};
+          dis_selective_update_service(pRpc->itsIdOut, clientIds);
+        }
+
+        // free the slot, or hand it over to the next queued request
+        if (m_holdsSlot) {
+          if (!m_context->m_queuedTasks.empty() && nullptr != m_context->m_pWorkerPool) {
+            nextTask = std::move(m_context->m_queuedTasks.front());
+            m_context->m_queuedTasks.pop_front();
+            pWorkerPool = m_context->m_pWorkerPool;
+          } else if (m_context->m_nInFlight > 0)
+            m_context->m_nInFlight--;
+        }
+      }
+      dim_unlock();
+
+      if (nullptr != pWorkerPool)
+        pWorkerPool->post(std::move(nextTask));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
     CommandHandler::CommandHandler(Server *pServer, const std::string &cname)
         : m_name(cname), m_pServer(pServer), m_pCommand(nullptr) {
     }
@@ -31,6 +31,8 @@
 #include <dqm4hep/Logging.h>
 
 // -- std headers
+#include <iterator>
+#include <set>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -45,6 +47,7 @@ namespace dqm4hep {
         : m_name(sname),
           m_started(false) {
       DimServer::addClientExitHandler(this);
+      core::fillHostInfo(m_hostInfo);
       m_serverInfoHandler = new RequestHandler(this, "/" + m_name + "/info", this, &Server::handleServerInfoRequest);
     }
 
@@ -54,6 +57,12 @@ namespace dqm4hep {
       this->stop();
       this->clear();
       delete m_serverInfoHandler;
+
+      // after the handlers: joins the workers still running requests
+      delete m_pRequestWorkerPool;
+
+      // after the services: their queued updates are gone
+      delete m_pPublisher.load();
     }
 
     //-------------------------------------------------------------------------------------------------
@@ -68,6 +77,8 @@ namespace dqm4hep {
       if (m_started)
         return;
 
+      this->checkNetworkDuplicates();
+
       for (auto iter = m_serviceMap.begin(), endIter = m_serviceMap.end(); endIter != iter; ++iter) {
         if (!iter->second->isServiceConnected())
           iter->second->connectService();
@@ -128,18 +139,28 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
 
     void Server::clear() {
-      for (auto iter = m_serviceMap.begin(), endIter = m_serviceMap.end(); endIter != iter; ++iter)
+      ServiceMap serviceMap;
+      RequestHandlerMap requestHandlerMap;
+      CommandHandlerMap commandHandlerMap;
+
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        serviceMap.swap(m_serviceMap);
+        requestHandlerMap.swap(m_requestHandlerMap);
+        commandHandlerMap.swap(m_commandHandlerMap);
+        this->invalidateServerInfo();
+      }
+
+      // deleted outside of the mutex: stopping them takes the dim lock
+      for (auto iter = serviceMap.begin(), endIter = serviceMap.end(); endIter != iter; ++iter)
         delete iter->second;
 
-      for (auto iter = m_requestHandlerMap.begin(), endIter = m_requestHandlerMap.end(); endIter != iter; ++iter)
+      for (auto iter = requestHandlerMap.begin(), endIter = requestHandlerMap.end(); endIter != iter; ++iter)
         delete iter->second;
 
-      for (auto iter = m_commandHandlerMap.begin(), endIter = m_commandHandlerMap.end(); endIter != iter; ++iter)
+      for (auto iter = commandHandlerMap.begin(), endIter = commandHandlerMap.end(); endIter != iter; ++iter)
         delete iter->second;
 
-      m_serviceMap.clear();
-      m_requestHandlerMap.clear();
-      m_commandHandlerMap.clear();
       DimServer::stop();
       m_started = false;
     }
@@ -155,11 +176,17 @@ namespace dqm4hep {
       if (findIter != m_serviceMap.end())
         return findIter->second;
 
-      if (Server::serviceAlreadyRunning(sname))
+      // before start(), checked all at once by checkNetworkDuplicates()
+      if (this->isRunning() && Server::serviceAlreadyRunning(sname))
         throw std::runtime_error("Server::createService(): service '" + sname + "' already running on network");
 
       // first insert nullptr, then create the service
-      std::pair<ServiceMap::iterator, bool> inserted = m_serviceMap.insert(ServiceMap::value_type(sname, nullptr));
+      std::pair<ServiceMap::iterator, bool> inserted;
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        inserted = m_serviceMap.insert(ServiceMap::value_type(sname, nullptr));
+        this->invalidateServerInfo();
+      }
 
       if (inserted.second) {
         Service *pService = new Service(this, sname);
@@ -274,6 +301,39 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    void Server::setNumberOfRequestWorkers(unsigned int nWorkers) {
+      if (nullptr != m_pRequestWorkerPool)
+        throw std::runtime_error("Server::setNumberOfRequestWorkers(): request worker pool already started");
+
+      m_nRequestWorkers = nWorkers;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Server::setAsyncPublishing(size_t maxQueueSize, Publisher::OverflowPolicy policy) {
+      if (nullptr != m_pPublisher)
+        throw std::runtime_error("Server::setAsyncPublishing(): asynchronous publishing already enabled");
+
+      m_pPublisher = new Publisher(maxQueueSize, policy);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    Publisher *Server::publisher() const {
+      return m_pPublisher;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    WorkerPool *Server::requestWorkerPool() {
+      if (nullptr == m_pRequestWorkerPool)
+        m_pRequestWorkerPool = new WorkerPool(m_nRequestWorkers);
+
+      return m_pRequestWorkerPool;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     int Server::clientId() const {
       return DimServer::getClientId();
     }
@@ -332,36 +392,56 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
-    void Server::handleServerInfoRequest(const Buffer & /*request*/, Buffer &response) {
-      // get the list of services, request handlers and command handlers
-      core::StringVector serviceList, requestHandlerList, commandHandlerList;
+    void Server::invalidateServerInfo() {
+      m_jsonServerInfo.reset();
+      m_binaryServerInfo.reset();
+    }
 
-      for (auto pservice : m_serviceMap) {
-        serviceList.push_back(pservice.second->name());
-      }
+    //-------------------------------------------------------------------------------------------------
 
-      for (auto request : m_requestHandlerMap) {
-        requestHandlerList.push_back(request.second->name());
-      }
+    void Server::handleServerInfoRequest(const Buffer &request, Buffer &response) {
+      const std::string &binaryRequest(ServerInfo::binaryRequest);
+      const bool binary = (request.size() >= binaryRequest.size() &&
+                           0 == binaryRequest.compare(0, binaryRequest.size(), request.begin(), binaryRequest.size()));
+      PayloadPtr serializedInfo;
 
-      for (auto command : m_commandHandlerMap) {
-        commandHandlerList.push_back(command.second->name());
-      }
+      {
+        std::lock_guard<std::mutex> lock(m_serverInfoMutex);
+        PayloadPtr &cachedInfo(binary ? m_binaryServerInfo : m_jsonServerInfo);
+
+        // rebuilt only after the services, request handlers or command handlers changed
+        if (nullptr == cachedInfo) {
+          ServerInfo serverInfo;
+          serverInfo.name = m_name;
+          serverInfo.hostInfo = m_hostInfo;
+
+          for (const auto &pservice : m_serviceMap)
+            serverInfo.services.push_back(pservice.first);
+
+          for (const auto &handler : m_requestHandlerMap)
+            serverInfo.requestHandlers.push_back(handler.first);
+
+          for (const auto &command : m_commandHandlerMap)
+            serverInfo.commandHandlers.push_back(command.first);
+
+          std::string serializedString;
 
-      // get host info
-      core::StringMap hostInfo;
-      core::fillHostInfo(hostInfo);
+          if (binary)
+            serverInfo.encode(serializedString);
+          else {
+            core::json jsonInfo;
+            serverInfo.toJson(jsonInfo);
+            serializedString = jsonInfo.dump();
+          }
 
-      core::json jsonResponse = {{"server", {{"name", m_name}}},
-                                 {"host", hostInfo},
-                                 {"services", serviceList},
-                                 {"requestHandlers", requestHandlerList},
-                                 {"commandHandlers", commandHandlerList}};
+          cachedInfo = Payload::create(std::move(serializedString));
+        }
 
-      std::string serializedJson = jsonResponse.dump();
-      auto model = response.createModel<std::string>();
-      response.setModel(model);
-      model->move(std::move(serializedJson));
+        serializedInfo = cachedInfo;
+      }
+
+      // shared with the cache, not copied
+      response.share(std::move(serializedInfo));
     }
 
     //-------------------------------------------------------------------------------------------------
@@ -453,6 +533,96 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    void Server::checkNetworkDuplicates() const {
+      if (DimServer::inCallback()) {
+        dqm_warning("Server::checkNetworkDuplicates: can't check for duplicated names on network !");
+        return;
+      }
+
+      // the names to look for, with their dim type. The async twin of a request handler is checked too
+      std::set<std::pair<std::string, int>> names;
+
+      for (auto &service : m_serviceMap)
+        names.insert(std::make_pair(service.first, DimSERVICE));
+
+      for (auto &requestHandler : m_requestHandlerMap) {
+        names.insert(std::make_pair(requestHandler.first, DimRPC));
+        names.insert(std::make_pair(RequestHandler::asyncRpcName(requestHandler.first), DimRPC));
+      }
+
+      for (auto &commandHandler : m_commandHandlerMap)
+        names.insert(std::make_pair(commandHandler.first, DimCOMMAND));
+
+      // the dns may list an rpc twice
+      std::set<std::string> duplicates;
+
+      // one dns query per top level prefix (e.g "/dqm4hep/"): a query on the common prefix of all
+      // the names could end up listing every service of the dns
+      for (auto first = names.begin(); first != names.end();) {
+        const std::string &firstName(first->first);
+        std::string::size_type topLevelEnd = firstName.find('/', 1);
+        std::string topLevel(firstName, 0, std::string::npos == topLevelEnd ? std::string::npos : topLevelEnd + 1);
+
+        auto last = first;
+        auto next = std::next(first);
+
+        while (next != names.end() && 0 == next->first.compare(0, topLevel.size(), topLevel))
+          last = next++;
+
+        // the names are sorted, the common prefix of the first and last ones is the one of the group
+        const std::string &lastName(last->first);
+        std::string::size_type length(0);
+
+        while (length < firstName.size() && length < lastName.size() && firstName[length] == lastName[length])
+          ++length;
+
+        std::string pattern(firstName, 0, length);
+
+        if (first != last)
+          pattern += "*";
+
+        DimBrowser browser;
+
+        if (0 != browser.getServices(pattern.c_str())) {
+          int serviceType;
+          char *serviceName, *format;
+
+          while (0 != (serviceType = browser.getNextService(serviceName, format))) {
+            std::string name(serviceName);
+
+            if (!names.count(std::make_pair(name, serviceType)))
+              continue;
+
+            if (serviceType == DimSERVICE)
+              duplicates.insert("service '" + name + "'");
+            else if (serviceType == DimRPC)
+              duplicates.insert("request handler '" + name + "'");
+            else if (serviceType == DimCOMMAND)
+              duplicates.insert("command handler '" + name + "'");
+          }
+        }
+
+        first = next;
+      }
+
+      if (duplicates.empty())
+        return;
+
+      const unsigned int maxListed(10);
+      unsigned int nListed(0);
+      std::string message("Server::start(): already running on network:");
+
+      for (auto iter = duplicates.begin(); iter != duplicates.end() && nListed < maxListed; ++iter, ++nListed)
+        message += " " + *iter;
+
+      if (duplicates.size() > maxListed)
+        message += " ... (" + std::to_string(duplicates.size()) + " in total)";
+
+      throw std::runtime_error(message);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     void Server::clientExitHandler() {
       int clientID(DimServer::getClientId());
       std::cout << "Client " << clientID << " exits" << std::endl;
@@ -0,0 +1,168 @@
+/// \file ServerInfo.cc
+/*
+ *
+ * ServerInfo.cc source template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "dqm4hep/ServerInfo.h"
+
+// -- std headers
+#include <algorithm>
+#include <cstring>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    const std::string ServerInfo::binaryRequest = "binary";
+    const uint32_t ServerInfo::binaryVersion = 1;
+
+    //-------------------------------------------------------------------------------------------------
+
+    static void encodeUInt(std::string &buffer, uint32_t value) {
+      buffer.append((const char *)&value, sizeof(value));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    static void encodeString(std::string &buffer, const std::string &value) {
+      encodeUInt(buffer, value.size());
+      buffer.append(value);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    static void encodeStrings(std::string &buffer, const core::StringVector &values) {
+      encodeUInt(buffer, values.size());
+
+      for (const auto &value : values)
+        encodeString(buffer, value);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    static bool decodeUInt(const char *&buffer, const char *end, uint32_t &value) {
+      if (end - buffer < (long)sizeof(value))
+        return false;
+
+      memcpy(&value, buffer, sizeof(value));
+      buffer += sizeof(value);
+      return true;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    static bool decodeString(const char *&buffer, const char *end, std::string &value) {
+      uint32_t length(0);
+
+      if (!decodeUInt(buffer, end, length) || end - buffer < (long)length)
+        return false;
+
+      value.assign(buffer, length);
+      buffer += length;
+      return true;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    static bool decodeStrings(const char *&buffer, const char *end, core::StringVector &values) {
+      uint32_t count(0);
+
+      if (!decodeUInt(buffer, end, count))
+        return false;
+
+      values.clear();
+      // each string takes at least its length
+      values.reserve(std::min<size_t>(count, (end - buffer) / sizeof(uint32_t)));
+
+      for (uint32_t i = 0; i < count; ++i) {
+        std::string value;
+
+        if (!decodeString(buffer, end, value))
+          return false;
+
+        values.push_back(std::move(value));
+      }
+
+      return true;
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    //-------------------------------------------------------------------------------------------------
+
+    void ServerInfo::toJson(core::json &value) const {
+      value = {{"server", {{"name", name}}},
+               {"host", hostInfo},
+               {"services", services},
+               {"requestHandlers", requestHandlers},
+               {"commandHandlers", commandHandlers}};
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void ServerInfo::encode(std::string &buffer) const {
+      buffer.clear();
+      encodeUInt(buffer, binaryVersion);
+      encodeString(buffer, name);
+      encodeUInt(buffer, hostInfo.size());
+
+      for (const auto &info : hostInfo) {
+        encodeString(buffer, info.first);
+        encodeString(buffer, info.second);
+      }
+
+      encodeStrings(buffer, services);
+      encodeStrings(buffer, requestHandlers);
+      encodeStrings(buffer, commandHandlers);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    bool ServerInfo::decode(const char *buffer, size_t size) {
+      const char *end = buffer + size;
+      uint32_t version(0), nHostInfo(0);
+
+      if (!decodeUInt(buffer, end, version) || version != binaryVersion)
+        return false;
+
+      if (!decodeString(buffer, end, name) || !decodeUInt(buffer, end, nHostInfo))
+        return false;
+
+      hostInfo.clear();
+
+      for (uint32_t i = 0; i < nHostInfo; ++i) {
+        std::string key, value;
+
+        if (!decodeString(buffer, end, key) || !decodeString(buffer, end, value))
+          return false;
+
+        hostInfo[key] = value;
+      }
+
+      return decodeStrings(buffer, end, services) && decodeStrings(buffer, end, requestHandlers) &&
+             decodeStrings(buffer, end, commandHandlers);
+    }
+  }
+}
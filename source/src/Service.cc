@@ -27,6 +27,8 @@
 
 // -- dqm4hep headers
 #include "dqm4hep/Service.h"
+#include "dqm4hep/Publisher.h"
+#include "dqm4hep/Server.h"
 
 namespace dqm4hep {
 
@@ -67,6 +69,11 @@ namespace dqm4hep {
     //-------------------------------------------------------------------------------------------------
 
     void Service::disconnectService() {
+      Publisher *pPublisher = m_pServer->publisher();
+
+      if (nullptr != pPublisher)
+        pPublisher->discard(this);
+
       if (this->isServiceConnected()) {
         delete m_pService;
         m_pService = nullptr;
@@ -105,25 +112,126 @@ namespace dqm4hep {
 
     //-------------------------------------------------------------------------------------------------
 
+    void Service::sendBuffer(const Buffer &buffer) {
+      this->sendData(buffer, std::vector<int>());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::sendBuffer(const Buffer &buffer, int clientId) {
+      this->sendData(buffer, std::vector<int>(1, clientId));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::sendBuffer(const Buffer &buffer, const std::vector<int> &clientIds) {
+      this->sendData(buffer, clientIds);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::sendBuffer(Buffer &&buffer) {
+      this->sendBuffer(std::move(buffer), std::vector<int>());
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::sendBuffer(Buffer &&buffer, const std::vector<int> &clientIds) {
+      if (!this->isServiceConnected())
+        throw; // TODO implement exceptions
+
+      Publisher *pPublisher = m_pServer->publisher();
+
+      // the contents is owned, queued without copy
+      if (nullptr != pPublisher) {
+        pPublisher->publish(this, std::move(buffer), clientIds);
+        return;
+      }
+
+      Buffer contents(std::move(buffer));
+      this->writeData(contents, clientIds);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
     void Service::sendData(const Buffer &buffer, const std::vector<int> &clientIds) {
       if (!this->isServiceConnected())
         throw; // TODO implement exceptions
 
-      if (clientIds.empty()) {
-        m_pService->updateService((void *)buffer.begin(), buffer.size());
-        m_pService->itsData = (void *)NullBuffer::buffer;
-        m_pService->itsSize = NullBuffer::size;
-      } else {
-        std::vector<int> clientIdList(clientIds);
+      Publisher *pPublisher = m_pServer->publisher();
+
+      if (nullptr == pPublisher) {
+        this->writeData(buffer, clientIds);
+        return;
+      }
+
+      // the caller keeps its buffer, queue a copy
+      Buffer contents;
 
-        if (clientIdList.back() != 0)
-          clientIdList.push_back(0);
+      if (buffer.isSegmented())
+        contents.share(buffer.payload());
+      else
+        contents.copy(buffer.begin(), buffer.size());
 
-        int *clientIdsArray = &clientIdList[0];
-        m_pService->selectiveUpdateService((void *)buffer.begin(), buffer.size(), clientIdsArray);
-        m_pService->itsData = (void *)NullBuffer::buffer;
-        m_pService->itsSize = NullBuffer::size;
+      pPublisher->publish(this, std::move(contents), clientIds);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::writeData(const Buffer &buffer, const std::vector<int> &clientIds) {
+      // stopped while the update was queued
+      if (!this->isServiceConnected())
+        return;
+
+      // always handed to dim as segments: dim reads them during the update only, under
+      // its lock, and never keeps a pointer on the buffer (itsData stays on NullBuffer).
+      // The buffer can be released as soon as we return
+      if (!buffer.isSegmented()) {
+        DIS_SEGMENT segment = {(void *)buffer.begin(), (int)buffer.size()};
+        this->sendSegments(&segment, 1, clientIds);
+        return;
       }
+
+      // gathered by dim directly in its packets, never concatenated here
+      std::vector<DIS_SEGMENT> segments;
+      segments.reserve(buffer.segments().size());
+
+      for (const auto &segment : buffer.segments())
+        segments.push_back(DIS_SEGMENT{(void *)segment.address, (int)segment.size});
+
+      this->sendSegments(segments.data(), segments.size(), clientIds);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void Service::sendSegments(DIS_SEGMENT *segments, int nSegments, const std::vector<int> &clientIds) {
+      std::vector<int> clientIdList(clientIds);
+
+      if (!clientIdList.empty() && clientIdList.back() != 0)
+        clientIdList.push_back(0);
+
+      int *clientIdsArray = clientIdList.empty() ? nullptr : &clientIdList[0];
+      int ret = clientIdsArray ? m_pService->selectiveUpdateService(segments, nSegments, clientIdsArray)
+                               : m_pService->updateService(segments, nSegments);
+
+      // -1: dim can not gather these segments (format to swap),
+      // concatenate them and update from the copy
+      if (ret != -1)
+        return;
+
+      std::vector<char> contents;
+
+      for (int i = 0; i < nSegments; i++)
+        contents.insert(contents.end(), (const char *)segments[i].address,
+                        (const char *)segments[i].address + segments[i].size);
+
+      if (clientIdsArray)
+        m_pService->selectiveUpdateService(contents.data(), contents.size(), clientIdsArray);
+      else
+        m_pService->updateService(contents.data(), contents.size());
+
+      m_pService->itsData = (void *)NullBuffer::buffer;
+      m_pService->itsSize = NullBuffer::size;
     }
   }
 }
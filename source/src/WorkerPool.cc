@@ -0,0 +1,107 @@
+/// \file WorkerPool.cc
+/*
+ *
+ * WorkerPool.cc source template automatically generated by a class generator
+ * Creation date : dim. oct. 18 2026
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Remi Ete
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "dqm4hep/WorkerPool.h"
+
+// -- std headers
+#include <algorithm>
+
+namespace dqm4hep {
+
+  namespace net {
+
+    WorkerPool::WorkerPool(unsigned int nWorkers) {
+      nWorkers = std::max(1U, nWorkers);
+
+      for (unsigned int w = 0; w < nWorkers; ++w)
+        m_workers.push_back(std::thread(&WorkerPool::run, this));
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    WorkerPool::~WorkerPool() {
+      std::deque<Task> tasks;
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        tasks.swap(m_tasks);
+      }
+
+      // destroyed outside of the mutex, a task may post from its destructor
+      tasks.clear();
+
+      m_condition.notify_all();
+
+      for (auto &worker : m_workers)
+        worker.join();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void WorkerPool::post(Task task) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_stop)
+          return;
+
+        m_tasks.push_back(std::move(task));
+      }
+
+      m_condition.notify_one();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    unsigned int WorkerPool::nWorkers() const {
+      return m_workers.size();
+    }
+
+    //-------------------------------------------------------------------------------------------------
+
+    void WorkerPool::run() {
+      while (true) {
+        Task task;
+
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+          if (m_stop)
+            return;
+
+          task = std::move(m_tasks.front());
+          m_tasks.pop_front();
+        }
+
+        task();
+      }
+    }
+  }
+}